@@ -0,0 +1,61 @@
+/*
+ * backend.c - The allocators mdriver can evaluate: the mm package it
+ *     was linked with, and mm variants loaded from shared objects.
+ *
+ * A variant is mmXXX.c compiled on its own into mmXXX.so. It is linked
+ * with -Bsymbolic so its calls to its own mm_* functions stay inside
+ * it, while its calls into memlib resolve to the copy in mdriver, which
+ * exports its symbols (-rdynamic). Every backend therefore allocates
+ * from the same simulated heap and is measured the same way.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "backend.h"
+
+backend_t mm_backend = {
+    "mm", mm_init, mm_init_hint, mm_malloc, mm_free, mm_realloc,
+    mem_reset_brk, mm_free_stats, mm_set_release_threshold,
+    mm_set_mmap_threshold
+};
+
+/*
+ * backend_load - Load an mm variant from a shared object
+ */
+backend_t *backend_load(char *path) {
+    backend_t *be;
+    void *handle;
+
+    if ((handle = dlopen(path, RTLD_NOW | RTLD_LOCAL)) == NULL) {
+        printf("Could not load %s: %s\n", path, dlerror());
+        return NULL;
+    }
+    if ((be = (backend_t *)calloc(1, sizeof(backend_t))) == NULL) {
+        dlclose(handle);
+        return NULL;
+    }
+
+    strncpy(be->name, path, sizeof(be->name) - 1);
+    *(void **)&be->init = dlsym(handle, "mm_init");
+    *(void **)&be->init_hint = dlsym(handle, "mm_init_hint");
+    *(void **)&be->malloc = dlsym(handle, "mm_malloc");
+    *(void **)&be->free = dlsym(handle, "mm_free");
+    *(void **)&be->realloc = dlsym(handle, "mm_realloc");
+    *(void **)&be->free_stats = dlsym(handle, "mm_free_stats");
+    *(void **)&be->set_release = dlsym(handle, "mm_set_release_threshold");
+    *(void **)&be->set_mmap = dlsym(handle, "mm_set_mmap_threshold");
+    be->reset = mem_reset_brk;
+
+    if (!be->init || !be->malloc || !be->free || !be->realloc) {
+        printf("%s does not define mm_init, mm_malloc, mm_free and mm_realloc\n",
+               path);
+        free(be);
+        dlclose(handle);
+        return NULL;
+    }
+    return be;
+}
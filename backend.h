@@ -0,0 +1,35 @@
+/*
+ * backend.h - An allocator under test, as a table of entry points, so
+ *     that mdriver can evaluate several allocators on the same traces
+ */
+
+typedef struct {
+    char name[256];
+    int (*init)(void);                         /* like mm_init */
+    /* like mm_init_hint, or NULL if the allocator takes no hint */
+    int (*init_hint)(size_t expected_peak);
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+    void *(*realloc)(void *ptr, size_t size);
+    void (*reset)(void);   /* empty the simulated heap before init */
+    /* free-list statistics for the -s timeline, or NULL if unknown */
+    void (*free_stats)(size_t *free_blocks, size_t *largest_free);
+    /* like mm_set_release_threshold, or NULL if not supported */
+    void (*set_release)(size_t bytes);
+    /* like mm_set_mmap_threshold, or NULL if not supported */
+    void (*set_mmap)(size_t bytes);
+} backend_t;
+
+/* The mm package linked into mdriver */
+extern backend_t mm_backend;
+
+/*
+ * backend_load - Load an allocator from a shared object built from an
+ *     mm variant (see the mm%.so rule in the Makefile). The object must
+ *     define mm_init, mm_malloc, mm_free and mm_realloc, may define
+ *     mm_init_hint, mm_free_stats, mm_set_release_threshold and
+ *     mm_set_mmap_threshold, and uses
+ *     mdriver's memlib. Returns NULL after printing the reason if the
+ *     object cannot be loaded.
+ */
+backend_t *backend_load(char *path);
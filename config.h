@@ -30,6 +30,18 @@
     "realloc-bal.rep",\
     "realloc2-bal.rep"
 
+/*
+ * The large-heap traces run by mdriver -L, with peaks of 0.3 to 2.5 GB
+ * and one 2.5 GB request. "make large-traces" generates them with mdgen
+ * in large/.
+ */
+#define LARGE_TRACEFILES \
+    "large-many.rep",\
+    "large-big.rep",\
+    "large-huge.rep",\
+    "large-realloc.rep",\
+    "large-grow.rep"
+
 /*
  * This constant gives the estimated performance of the libc malloc
  * package using our traces on some reference system, typically the
@@ -38,6 +50,9 @@
  * students surpass the AVG_LIBC_THRUPUT, they get no further benefit
  * to their score.  This deters students from building extremely fast,
  * but extremely stupid malloc packages.
+ *
+ * mdriver now measures libc on the host and caps at that instead (see
+ * its -R flag); this value is only used if libc fails every trace.
  */
 #define AVG_LIBC_THRUPUT      600E3  /* 600 Kops/sec */
 
@@ -57,9 +72,11 @@
  * Maximum heap size in bytes 
  */
 #define MAX_HEAP (20*(1<<20))  /* 20 MB */
+#define LARGE_MAX_HEAP ((size_t)16 << 30)  /* 16 GB, for mdriver -L */
 
 /*****************************************************************************
- * Set exactly one of these USE_xxx constants to "1" to select a timing method
+ * Set exactly one of these USE_xxx constants to "1" to select the default
+ * timing method. mdriver's -T flag overrides it at runtime.
  *****************************************************************************/
 #define USE_FCYC   0   /* cycle counter w/K-best scheme (x86 & Alpha only) */
 #define USE_ITIMER 0   /* interval timer (any Unix box) */
@@ -7,6 +7,7 @@
 #include <stdlib.h>
 #include <sys/times.h>
 #include <stdio.h>
+#include <math.h>
 
 #include "fcyc.h"
 #include "clock.h"
@@ -33,6 +34,9 @@ static int *cache_buf = NULL;
 static double *values = NULL;
 static int samplecount = 0;
 
+static double last_stddev = 0;  /* spread of the K best of the last fcyc */
+static int last_samplecount = 0;
+
 /* for debugging only */
 #define KEEP_VALS 0
 #define KEEP_SAMPLES 0
@@ -152,6 +156,16 @@ double fcyc(test_funct f, void *argp) {
     }
 #endif
     result = values[0];
+    {
+	int i, n = (samplecount < kbest) ? samplecount : kbest;
+	double mean = 0, var = 0;
+	for (i = 0; i < n; i++)
+	    mean += values[i] / n;
+	for (i = 0; i < n; i++)
+	    var += (values[i] - mean) * (values[i] - mean);
+	last_stddev = (n > 1) ? sqrt(var / (n - 1)) : 0;
+	last_samplecount = n;
+    }
 #if !KEEP_VALS
     free(values); 
     values = NULL;
@@ -160,6 +174,22 @@ double fcyc(test_funct f, void *argp) {
 }
 
 
+/*
+ * fcyc_stddev - Standard deviation (in cycles) of the K best samples
+ *     of the last fcyc call
+ */
+double fcyc_stddev(void) {
+    return last_stddev;
+}
+
+/*
+ * fcyc_samples - Number of samples (at most K) behind fcyc_stddev
+ */
+int fcyc_samples(void) {
+    return last_samplecount;
+}
+
+
 /*************************************************************
  * Set the various parameters used by the measurement routines 
  ************************************************************/
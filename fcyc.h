@@ -10,6 +10,12 @@ typedef void (*test_funct)(void *);
 /* Compute number of cycles used by test function f */
 double fcyc(test_funct f, void* argp);
 
+/* Standard deviation (in cycles) of the K best samples of the last fcyc */
+double fcyc_stddev(void);
+
+/* Number of samples (at most K) behind fcyc_stddev */
+int fcyc_samples(void);
+
 /*********************************************************
  * Set the various parameters used by measurement routines 
  *********************************************************/
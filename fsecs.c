@@ -10,46 +10,126 @@
 
 static double Mhz;  /* estimated CPU clock frequency */
 
+/* timing method, defaulting to the one selected in config.h */
+#if USE_FCYC
+static int method = FSECS_FCYC;
+#elif USE_ITIMER
+static int method = FSECS_ITIMER;
+#else
+static int method = FSECS_GETTOD;
+#endif
+
+static int runs = 10;         /* runs averaged by the non-fcyc timers */
+static double last_stddev;    /* std deviation behind the last fsecs() */
+static int last_samples;      /* samples behind the last fsecs() */
+
 extern int verbose; /* -v option in mdriver.c */
 
+/*
+ * set_fsecs_method - Select the timing method used by fsecs. Must be
+ *     called before init_fsecs.
+ */
+void set_fsecs_method(int method_arg) {
+    method = method_arg;
+}
+
+/*
+ * set_fsecs_runs - Number of runs averaged by the itimer, gettod and
+ *     clock methods
+ */
+void set_fsecs_runs(int runs_arg) {
+    runs = runs_arg;
+}
+
 /*
  * init_fsecs - initialize the timing package
  */
 void init_fsecs(void) {
     Mhz = 0; /* keep gcc -Wall happy */
 
-#if USE_FCYC
-    if (verbose)
-	printf("Measuring performance with a cycle counter.\n");
-
-    /* set key parameters for the fcyc package */
-    set_fcyc_maxsamples(20); 
-    set_fcyc_clear_cache(1);
-    set_fcyc_compensate(1);
-    set_fcyc_epsilon(0.01);
-    set_fcyc_k(3);
-    Mhz = mhz(verbose > 0);
-#elif USE_ITIMER
-    if (verbose)
-	printf("Measuring performance with the interval timer.\n");
-#elif USE_GETTOD
-    if (verbose)
-	printf("Measuring performance with gettimeofday().\n");
-#endif
+    switch (method) {
+    case FSECS_FCYC:
+	if (verbose)
+	    printf("Measuring performance with a cycle counter.\n");
+
+	/* set key parameters for the fcyc package */
+	set_fcyc_maxsamples(20); 
+	set_fcyc_clear_cache(1);
+	set_fcyc_compensate(1);
+	set_fcyc_epsilon(0.01);
+	set_fcyc_k(3);
+	Mhz = mhz(verbose > 0);
+	break;
+    case FSECS_ITIMER:
+	if (verbose)
+	    printf("Measuring performance with the interval timer.\n");
+	break;
+    case FSECS_GETTOD:
+	if (verbose)
+	    printf("Measuring performance with gettimeofday().\n");
+	break;
+    case FSECS_CLOCK:
+	if (verbose)
+	    printf("Measuring performance with clock_gettime(CLOCK_MONOTONIC_RAW).\n");
+	break;
+    }
 }
 
 /*
  * fsecs - Return the running time of a function f (in seconds)
  */
 double fsecs(fsecs_test_funct f, void *argp) {
-#if USE_FCYC
-    double cycles = fcyc(f, argp);
-    return cycles/(Mhz*1e6);
-#elif USE_ITIMER
-    return ftimer_itimer(f, argp, 10);
-#elif USE_GETTOD
-    return ftimer_gettod(f, argp, 10);
-#endif 
+    double secs = 0;
+
+    switch (method) {
+    case FSECS_FCYC:
+	secs = fcyc(f, argp)/(Mhz*1e6);
+	last_stddev = fcyc_stddev()/(Mhz*1e6);
+	last_samples = fcyc_samples();
+	return secs;
+    case FSECS_ITIMER:
+	secs = ftimer_itimer(f, argp, runs);
+	break;
+    case FSECS_GETTOD:
+	secs = ftimer_gettod(f, argp, runs);
+	break;
+    case FSECS_CLOCK:
+	secs = ftimer_clock(f, argp, runs);
+	break;
+    }
+    last_stddev = ftimer_stddev();
+    last_samples = runs;
+    return secs;
 }
 
+/*
+ * fsecs_stddev - Return the standard deviation (in seconds) of the
+ *     samples behind the last fsecs call
+ */
+double fsecs_stddev(void) {
+    return last_stddev;
+}
 
+/*
+ * fsecs_samples - Return the number of samples behind the last fsecs
+ *     call
+ */
+int fsecs_samples(void) {
+    return last_samples;
+}
+
+/*
+ * fsecs_method - Return a short name for the timing method in use
+ */
+char *fsecs_method(void) {
+    switch (method) {
+    case FSECS_FCYC:
+	return "fcyc";
+    case FSECS_ITIMER:
+	return "itimer";
+    case FSECS_CLOCK:
+	return "clock";
+    default:
+	return "gettod";
+    }
+}
@@ -1,4 +1,15 @@
 typedef void (*fsecs_test_funct)(void *);
 
+/* Timing methods for set_fsecs_method */
+#define FSECS_FCYC   0   /* cycle counter w/K-best scheme (x86 & Alpha only) */
+#define FSECS_ITIMER 1   /* interval timer */
+#define FSECS_GETTOD 2   /* gettimeofday */
+#define FSECS_CLOCK  3   /* clock_gettime(CLOCK_MONOTONIC_RAW) */
+
+void set_fsecs_method(int method);
+void set_fsecs_runs(int runs);
 void init_fsecs(void);
 double fsecs(fsecs_test_funct f, void *argp);
+double fsecs_stddev(void);
+int fsecs_samples(void);
+char *fsecs_method(void);
@@ -4,29 +4,43 @@
  * Function timers that estimate the running time (in seconds) of a function f.
  *    ftimer_itimer: version that uses the interval timer
  *    ftimer_gettod: version that uses gettimeofday
+ *    ftimer_clock:  version that uses clock_gettime(CLOCK_MONOTONIC_RAW)
+ *
+ * Each run is timed on its own so that ftimer_stddev can report the
+ * spread of the runs behind the returned average.
  */
 #include <stdio.h>
+#include <math.h>
+#include <time.h>
 #include <sys/time.h>
 #include "ftimer.h"
 
 /* function prototypes */
 static void init_etime(void);
 static double get_etime(void);
+static void add_run(double secs);
+static double finish_runs(void);
+
+/* running sums over the runs of the current measurement */
+static int nruns;
+static double sum, sumsq;
+static double last_stddev;
 
 /* 
  * ftimer_itimer - Use the interval timer to estimate the running time
  * of f(argp). Return the average of n runs.  
  */
 double ftimer_itimer(ftimer_test_funct f, void *argp, int n) {
-    double start, tmeas;
+    double start;
     int i;
 
     init_etime();
-    start = get_etime();
-    for (i = 0; i < n; i++) 
+    for (i = 0; i < n; i++) {
+	start = get_etime();
 	f(argp);
-    tmeas = get_etime() - start;
-    return tmeas / n;
+	add_run(get_etime() - start);
+    }
+    return finish_runs();
 }
 
 /* 
@@ -36,15 +50,59 @@ double ftimer_itimer(ftimer_test_funct f, void *argp, int n) {
 double ftimer_gettod(ftimer_test_funct f, void *argp, int n) {
     int i;
     struct timeval stv, etv;
-    double diff;
 
-    gettimeofday(&stv, NULL);
-    for (i = 0; i < n; i++) 
+    for (i = 0; i < n; i++) {
+	gettimeofday(&stv, NULL);
+	f(argp);
+	gettimeofday(&etv,NULL);
+	add_run((etv.tv_sec - stv.tv_sec) + 1E-6*(etv.tv_usec-stv.tv_usec));
+    }
+    return finish_runs();
+}
+
+/* 
+ * ftimer_clock - Use clock_gettime(CLOCK_MONOTONIC_RAW) to estimate
+ * the running time of f(argp). Return the average of n runs.  
+ */
+double ftimer_clock(ftimer_test_funct f, void *argp, int n) {
+    int i;
+    struct timespec sts, ets;
+
+    for (i = 0; i < n; i++) {
+	clock_gettime(CLOCK_MONOTONIC_RAW, &sts);
 	f(argp);
-    gettimeofday(&etv,NULL);
-    diff = 1E3*(etv.tv_sec - stv.tv_sec) + 1E-3*(etv.tv_usec-stv.tv_usec);
-    diff /= n;
-    return (1E-3*diff);
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ets);
+	add_run((ets.tv_sec - sts.tv_sec) + 1E-9*(ets.tv_nsec-sts.tv_nsec));
+    }
+    return finish_runs();
+}
+
+/*
+ * ftimer_stddev - Return the sample standard deviation of the runs
+ * behind the last ftimer_xxx call
+ */
+double ftimer_stddev(void) {
+    return last_stddev;
+}
+
+/* record the time of one run */
+static void add_run(double secs) {
+    nruns++;
+    sum += secs;
+    sumsq += secs * secs;
+}
+
+/* return the average of the recorded runs and start over */
+static double finish_runs(void) {
+    double mean = nruns ? sum / nruns : 0;
+    double var = 0;
+
+    if (nruns > 1)
+	var = (sumsq - nruns * mean * mean) / (nruns - 1);
+    last_stddev = (var > 0) ? sqrt(var) : 0;
+    nruns = 0;
+    sum = sumsq = 0;
+    return mean;
 }
 
 
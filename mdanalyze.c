@@ -0,0 +1,418 @@
+/*
+ * mdanalyze.c - Characterize the workload in .rep trace files.
+ *
+ * For each trace, reports the request-size histogram, the lifetime of
+ * each block in requests between its allocation and its free, the peak
+ * live bytes and blocks, the length of each block's chain of reallocs
+ * and the factor by which each realloc grows it, and the fraction of
+ * frees that release the most recently allocated live block (LIFO).
+ *
+ * Traces are read a request at a time with trace_next, and the only
+ * per-trace state is a few words per block id, so a trace of any
+ * length is analyzed in one pass. Histograms use power-of-two buckets.
+ * The report is printed as text; -o also writes every table to a CSV
+ * file, one row per bucket.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "trace.h"
+
+#define MAXLINE   1024 /* max string size */
+#define NBUCKETS    65 /* 0, then one per power of two up to 2^63 */
+#define NGROWTH      7 /* buckets of realloc growth factors */
+
+/* A power-of-two histogram. Bucket 0 holds 0, bucket 1 holds 1 and
+   bucket b > 1 holds (2^(b-2), 2^(b-1)]. */
+typedef struct {
+    long count[NBUCKETS];
+    double bytes[NBUCKETS];  /* sum of the values in each bucket */
+} hist_t;
+
+/* Everything reported about one trace */
+typedef struct {
+    long ops, allocs, reallocs, frees;
+    long lifo_frees;         /* frees of the newest live block */
+    long never_freed;        /* blocks still live at the end */
+    size_t live_bytes, peak_bytes;
+    long live_blocks, peak_blocks;
+    long peak_bytes_op;      /* request at which peak_bytes was reached */
+    hist_t sizes;            /* alloc and realloc request sizes */
+    hist_t lifetimes;        /* requests from alloc to free */
+    hist_t chains;           /* reallocs per block */
+    long growth[NGROWTH];    /* realloc new/old size factors */
+    double growth_sum;       /* for the mean factor */
+    long growth_n;
+} analysis_t;
+
+static char *growth_names[NGROWTH] = {
+    "<1", "1", "1-1.25", "1.25-1.5", "1.5-2", "2-4", ">4"
+};
+
+/*
+ * Per-id state. Live blocks are also kept on a doubly linked list in
+ * allocation order, whose tail is the newest live block.
+ */
+static size_t *sizes = NULL;     /* current size of each live id */
+static long *birth = NULL;       /* request that allocated each id */
+static long *chain = NULL;       /* reallocs of each id so far */
+static long *next_id = NULL, *prev_id = NULL;
+static char *is_live = NULL;
+static long max_ids = 0;
+static long head = -1, tail = -1;
+
+int verbose = 0; /* read by trace.c */
+
+static void analyze(char *path, analysis_t *a);
+static void print_report(FILE *fp, char *name, analysis_t *a);
+static void write_csv(FILE *fp, char *name, analysis_t *a, int header);
+static void usage(void);
+static void app_error(char *msg);
+
+int main(int argc, char **argv) {
+    analysis_t a;
+    char *outfile = NULL;
+    FILE *csv = NULL;
+    int i;
+    char c;
+
+    while ((c = getopt(argc, argv, "o:h")) != EOF) {
+        switch (c) {
+        case 'o': /* Also write the tables as CSV */
+            outfile = optarg;
+            break;
+        case 'h': /* Print this message */
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (optind == argc) {
+        usage();
+        exit(1);
+    }
+
+    if (outfile != NULL && (csv = fopen(outfile, "w")) == NULL) {
+        perror(outfile);
+        exit(1);
+    }
+    for (i = optind; i < argc; i++) {
+        analyze(argv[i], &a);
+        print_report(stdout, argv[i], &a);
+        if (csv != NULL)
+            write_csv(csv, argv[i], &a, i == optind);
+    }
+    if (csv != NULL)
+        fclose(csv);
+    exit(0);
+}
+
+/*******************************************************
+ * The following routines gather the statistics
+ *******************************************************/
+
+/* bucket - The histogram bucket holding v */
+static int bucket(unsigned long v) {
+    int b = 1;
+
+    if (v == 0)
+        return 0;
+    while (b < NBUCKETS - 1 && v > (1UL << (b - 1)))
+        b++;
+    return b;
+}
+
+static void hist_add(hist_t *h, unsigned long v) {
+    int b = bucket(v);
+    h->count[b]++;
+    h->bytes[b] += v;
+}
+
+/*
+ * grow_ids - Make room for ids up to id. The header's num_ids is only
+ *     a hint, so a trace with a wrong header is still analyzed.
+ */
+static void grow_ids(long id) {
+    long n = max_ids;
+
+    if (id < max_ids)
+        return;
+    while (n <= id)
+        n = n ? 2 * n : 4096;
+    sizes = realloc(sizes, n * sizeof(size_t));
+    birth = realloc(birth, n * sizeof(long));
+    chain = realloc(chain, n * sizeof(long));
+    next_id = realloc(next_id, n * sizeof(long));
+    prev_id = realloc(prev_id, n * sizeof(long));
+    is_live = realloc(is_live, n);
+    if (!sizes || !birth || !chain || !next_id || !prev_id || !is_live)
+        app_error("Out of memory for block ids");
+    memset(is_live + max_ids, 0, n - max_ids);
+    max_ids = n;
+}
+
+static void list_append(long id) {
+    next_id[id] = -1;
+    prev_id[id] = tail;
+    if (tail >= 0)
+        next_id[tail] = id;
+    else
+        head = id;
+    tail = id;
+}
+
+static void list_remove(long id) {
+    if (prev_id[id] >= 0)
+        next_id[prev_id[id]] = next_id[id];
+    else
+        head = next_id[id];
+    if (next_id[id] >= 0)
+        prev_id[next_id[id]] = prev_id[id];
+    else
+        tail = prev_id[id];
+}
+
+/* retire - Account for a block whose life is over */
+static void retire(analysis_t *a, long id) {
+    hist_add(&a->chains, chain[id]);
+    a->live_bytes -= sizes[id];
+    a->live_blocks--;
+    is_live[id] = 0;
+    list_remove(id);
+}
+
+static void add_growth(analysis_t *a, size_t oldsize, size_t newsize) {
+    double f;
+    int g;
+
+    if (oldsize == 0)
+        return;
+    f = (double)newsize / oldsize;
+    if (f < 1)
+        g = 0;
+    else if (f == 1)
+        g = 1;
+    else if (f <= 1.25)
+        g = 2;
+    else if (f <= 1.5)
+        g = 3;
+    else if (f <= 2)
+        g = 4;
+    else if (f <= 4)
+        g = 5;
+    else
+        g = 6;
+    a->growth[g]++;
+    a->growth_sum += f;
+    a->growth_n++;
+}
+
+/*
+ * analyze - Read the trace at path in one pass and fill in a
+ */
+static void analyze(char *path, analysis_t *a) {
+    trace_reader_t r;
+    traceop_t op;
+    char msg[MAXLINE + 64];
+    long id, i;
+
+    memset(a, 0, sizeof(*a));
+    if (trace_open(&r, path) < 0) {
+        sprintf(msg, "Could not open %.1000s", path);
+        app_error(msg);
+    }
+    if (r.num_ids > 0)
+        grow_ids(r.num_ids - 1);
+    memset(is_live, 0, max_ids);
+    head = tail = -1;
+
+    while (trace_next(&r, &op)) {
+        id = op.index;
+        grow_ids(id);
+        switch (op.type) {
+        case ALLOC:
+            a->allocs++;
+            hist_add(&a->sizes, op.size);
+            if (is_live[id])     /* id reused without a free */
+                retire(a, id);
+            sizes[id] = op.size;
+            birth[id] = a->ops;
+            chain[id] = 0;
+            is_live[id] = 1;
+            list_append(id);
+            a->live_bytes += op.size;
+            a->live_blocks++;
+            break;
+        case REALLOC:
+            a->reallocs++;
+            hist_add(&a->sizes, op.size);
+            if (!is_live[id]) {  /* realloc(NULL, size) */
+                sizes[id] = 0;
+                birth[id] = a->ops;
+                chain[id] = 0;
+                is_live[id] = 1;
+                list_append(id);
+                a->live_blocks++;
+            } else {
+                add_growth(a, sizes[id], op.size);
+                chain[id]++;
+            }
+            a->live_bytes += op.size - sizes[id];
+            sizes[id] = op.size;
+            break;
+        case FREE:
+            a->frees++;
+            if (!is_live[id])
+                break;
+            if (id == tail)
+                a->lifo_frees++;
+            hist_add(&a->lifetimes, a->ops - birth[id]);
+            retire(a, id);
+            break;
+        }
+        a->ops++;
+        if (a->live_bytes > a->peak_bytes) {
+            a->peak_bytes = a->live_bytes;
+            a->peak_bytes_op = a->ops - 1;
+        }
+        if (a->live_blocks > a->peak_blocks)
+            a->peak_blocks = a->live_blocks;
+    }
+    trace_close(&r);
+
+    /* Blocks never freed still end their realloc chains */
+    for (i = head; i >= 0; i = next_id[i]) {
+        hist_add(&a->chains, chain[i]);
+        a->never_freed++;
+    }
+}
+
+/*******************************************************
+ * The following routines print the results
+ *******************************************************/
+
+/* bucket_name - Print the range of values in bucket b into buf */
+static char *bucket_name(char *buf, int b) {
+    if (b < 3)
+        sprintf(buf, "%d", b);
+    else
+        sprintf(buf, "%lu-%lu", (1UL << (b - 2)) + 1, 1UL << (b - 1));
+    return buf;
+}
+
+static double pct(long part, long whole) {
+    return whole ? 100.0 * part / whole : 0.0;
+}
+
+static void print_hist(FILE *fp, char *title, hist_t *h, int bytes) {
+    char name[64];
+    long total = 0;
+    int b;
+
+    for (b = 0; b < NBUCKETS; b++)
+        total += h->count[b];
+    if (bytes)
+        fprintf(fp, "\n  %-22s %10s %7s %14s\n", title, "count", "%", "bytes");
+    else
+        fprintf(fp, "\n  %-22s %10s %7s\n", title, "count", "%");
+    for (b = 0; b < NBUCKETS; b++) {
+        if (h->count[b] == 0)
+            continue;
+        fprintf(fp, "  %-22s %10ld %6.1f%%", bucket_name(name, b),
+                h->count[b], pct(h->count[b], total));
+        if (bytes)
+            fprintf(fp, " %14.0f", h->bytes[b]);
+        fprintf(fp, "\n");
+    }
+}
+
+/*
+ * print_report - Print the analysis of one trace as text
+ */
+static void print_report(FILE *fp, char *name, analysis_t *a) {
+    int g;
+
+    fprintf(fp, "Trace %s\n", name);
+    fprintf(fp, "  requests     %10ld (%ld allocs, %ld reallocs, %ld frees)\n",
+            a->ops, a->allocs, a->reallocs, a->frees);
+    fprintf(fp, "  peak bytes   %10zu at request %ld\n",
+            a->peak_bytes, a->peak_bytes_op);
+    fprintf(fp, "  peak blocks  %10ld\n", a->peak_blocks);
+    fprintf(fp, "  never freed  %10ld\n", a->never_freed);
+    fprintf(fp, "  LIFO frees   %10ld (%.1f%% of frees)\n",
+            a->lifo_frees, pct(a->lifo_frees, a->frees));
+
+    print_hist(fp, "request size (bytes)", &a->sizes, 1);
+    print_hist(fp, "lifetime (requests)", &a->lifetimes, 0);
+    print_hist(fp, "reallocs per block", &a->chains, 0);
+
+    if (a->growth_n > 0) {
+        fprintf(fp, "\n  %-22s %10s %7s\n", "realloc growth", "count", "%");
+        for (g = 0; g < NGROWTH; g++)
+            if (a->growth[g] > 0)
+                fprintf(fp, "  %-22s %10ld %6.1f%%\n", growth_names[g],
+                        a->growth[g], pct(a->growth[g], a->growth_n));
+        fprintf(fp, "  %-22s %10.3f\n", "mean factor",
+                a->growth_sum / a->growth_n);
+    }
+    fprintf(fp, "\n");
+}
+
+static void csv_hist(FILE *fp, char *name, char *table, hist_t *h) {
+    char bname[64];
+    int b;
+
+    for (b = 0; b < NBUCKETS; b++)
+        if (h->count[b] > 0)
+            fprintf(fp, "%s,%s,%s,%ld,%.0f\n", name, table,
+                    bucket_name(bname, b), h->count[b], h->bytes[b]);
+}
+
+/*
+ * write_csv - Write the analysis of one trace as CSV rows of
+ *     trace,table,bucket,count,value. value is the sum of the values in
+ *     the bucket for histograms; summary rows carry their number in count.
+ */
+static void write_csv(FILE *fp, char *name, analysis_t *a, int header) {
+    int g;
+
+    if (header)
+        fprintf(fp, "trace,table,bucket,count,value\n");
+    fprintf(fp, "%s,summary,requests,%ld,0\n", name, a->ops);
+    fprintf(fp, "%s,summary,allocs,%ld,0\n", name, a->allocs);
+    fprintf(fp, "%s,summary,reallocs,%ld,0\n", name, a->reallocs);
+    fprintf(fp, "%s,summary,frees,%ld,0\n", name, a->frees);
+    fprintf(fp, "%s,summary,peak_bytes,%zu,0\n", name, a->peak_bytes);
+    fprintf(fp, "%s,summary,peak_blocks,%ld,0\n", name, a->peak_blocks);
+    fprintf(fp, "%s,summary,never_freed,%ld,0\n", name, a->never_freed);
+    fprintf(fp, "%s,summary,lifo_frees,%ld,0\n", name, a->lifo_frees);
+    csv_hist(fp, name, "size", &a->sizes);
+    csv_hist(fp, name, "lifetime", &a->lifetimes);
+    csv_hist(fp, name, "chain", &a->chains);
+    for (g = 0; g < NGROWTH; g++)
+        if (a->growth[g] > 0)
+            fprintf(fp, "%s,growth,%s,%ld,0\n", name, growth_names[g],
+                    a->growth[g]);
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void) {
+    fprintf(stderr, "Usage: mdanalyze [-h] [-o <file>] <tracefile>...\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h          Print this message.\n");
+    fprintf(stderr, "\t-o <file>   Also write the tables to <file> as CSV.\n");
+}
+
+/*
+ * app_error - Report an error and exit
+ */
+static void app_error(char *msg) {
+    fprintf(stderr, "mdanalyze: %s\n", msg);
+    exit(1);
+}
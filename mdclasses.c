@@ -0,0 +1,269 @@
+/*
+ * mdclasses.c - Compute size classes for mm.c from .rep traces.
+ *
+ * Every alloc and realloc request in the traces is rounded to the block
+ * size mm_malloc would use for it (payload of at least 32 bytes, aligned
+ * to WORD_SIZE, plus the two tags). mdclasses then picks at most k class
+ * bounds, each one of the observed block sizes, that minimize the total
+ * internal fragmentation when every block is rounded up to the bound of
+ * its class:
+ *
+ *     sum over requests of (class bound - block size)
+ *
+ * The optimum is found exactly by dynamic programming over the sorted
+ * distinct block sizes: best[j][i] is the least waste covering the i
+ * smallest sizes with j classes, the largest of which ends at size i.
+ * With prefix sums of counts and bytes, the waste of one class is O(1),
+ * so the whole table takes O(k n^2) for n distinct sizes.
+ *
+ * The result is written as a C header (mm_classes.h) that mm.c includes
+ * at compile time.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "mm.h"
+#include "trace.h"
+
+#define MAXLINE      1024 /* max string size */
+#define MAXCLASSES     64 /* largest -k we accept */
+#define DEFCLASSES     16 /* default -k */
+
+/* One distinct block size and how often it was requested */
+typedef struct {
+    size_t size;
+    double count;
+} sizecount_t;
+
+/* Distinct block sizes, in an open-addressing table while reading */
+static sizecount_t *table = NULL;
+static size_t table_mask = 0, table_used = 0;
+
+int verbose = 0; /* read by trace.c */
+
+static void count_trace(char *path);
+static void add_size(size_t size);
+static int size_cmp(const void *a, const void *b);
+static void usage(void);
+static void app_error(char *msg);
+
+int main(int argc, char **argv) {
+    int k = DEFCLASSES;
+    char *outfile = NULL;
+    FILE *fp = stdout;
+    sizecount_t *sizes;
+    size_t n, i, m;
+    int j, c;
+    double *cum_count, *cum_bytes;  /* prefix sums over sizes[0..i) */
+    double *best, *prev;            /* best[j * (n+1) + i], see above */
+    size_t *from;                   /* the i that achieved each best */
+    size_t bounds[MAXCLASSES];
+    double waste, total_bytes, cost;
+    int a;
+
+    while ((a = getopt(argc, argv, "k:o:h")) != EOF) {
+        switch (a) {
+        case 'k': /* Class budget */
+            k = atoi(optarg);
+            if (k < 1 || k > MAXCLASSES)
+                app_error("-k must be between 1 and 64");
+            break;
+        case 'o': /* Output file */
+            outfile = optarg;
+            break;
+        case 'h': /* Print this message */
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (optind == argc) {
+        usage();
+        exit(1);
+    }
+
+    for (a = optind; a < argc; a++)
+        count_trace(argv[a]);
+    if (table_used == 0)
+        app_error("No allocation requests in the traces");
+
+    /* Pack the distinct sizes and sort them */
+    if ((sizes = malloc(table_used * sizeof(sizecount_t))) == NULL)
+        app_error("Out of memory");
+    for (i = 0, n = 0; i <= table_mask; i++)
+        if (table[i].size != 0)
+            sizes[n++] = table[i];
+    qsort(sizes, n, sizeof(sizecount_t), size_cmp);
+    if ((size_t)k > n)
+        k = n;
+
+    cum_count = malloc((n + 1) * sizeof(double));
+    cum_bytes = malloc((n + 1) * sizeof(double));
+    best = malloc((size_t)k * (n + 1) * sizeof(double));
+    from = malloc((size_t)k * (n + 1) * sizeof(size_t));
+    if (!cum_count || !cum_bytes || !best || !from)
+        app_error("Out of memory");
+    cum_count[0] = cum_bytes[0] = 0;
+    for (i = 0; i < n; i++) {
+        cum_count[i + 1] = cum_count[i] + sizes[i].count;
+        cum_bytes[i + 1] = cum_bytes[i] + sizes[i].count * sizes[i].size;
+    }
+
+/* waste of one class holding sizes[lo..hi), bounded by sizes[hi-1] */
+#define CLASS_WASTE(lo, hi) \
+    ((cum_count[hi] - cum_count[lo]) * sizes[(hi) - 1].size - \
+     (cum_bytes[hi] - cum_bytes[lo]))
+
+    /* One class: everything rounds up to the largest size */
+    for (i = 1; i <= n; i++) {
+        best[i] = CLASS_WASTE(0, i);
+        from[i] = 0;
+    }
+    for (j = 1; j < k; j++) {
+        prev = &best[(j - 1) * (n + 1)];
+        for (i = j + 1; i <= n; i++) {
+            double b = -1;
+            size_t arg = j;
+            for (m = j; m < i; m++) {
+                cost = prev[m] + CLASS_WASTE(m, i);
+                if (b < 0 || cost < b) {
+                    b = cost;
+                    arg = m;
+                }
+            }
+            best[j * (n + 1) + i] = b;
+            from[j * (n + 1) + i] = arg;
+        }
+    }
+
+    /* Walk back from the full set of sizes to recover the bounds */
+    waste = best[(k - 1) * (n + 1) + n];
+    for (j = k - 1, i = n; j >= 0; j--) {
+        bounds[j] = sizes[i - 1].size;
+        i = from[j * (n + 1) + i];
+    }
+    total_bytes = cum_bytes[n];
+
+    if (outfile != NULL && (fp = fopen(outfile, "w")) == NULL) {
+        perror(outfile);
+        exit(1);
+    }
+    fprintf(fp, "/*\n");
+    fprintf(fp, " * mm_classes.h - Size classes for mm.c's segregated free lists.\n");
+    fprintf(fp, " *\n");
+    fprintf(fp, " * Generated by:");
+    for (c = 0; c < argc; c++)
+        fprintf(fp, " %s", argv[c]);
+    fprintf(fp, "\n");
+    fprintf(fp, " * Internal fragmentation on those traces: %.2f%% of block bytes.\n",
+            total_bytes > 0 ? 100.0 * waste / total_bytes : 0.0);
+    fprintf(fp, " */\n");
+    fprintf(fp, "#ifndef MM_CLASSES_H_\n");
+    fprintf(fp, "#define MM_CLASSES_H_\n\n");
+    fprintf(fp, "#define MM_NUM_CLASSES %d\n\n", k);
+    fprintf(fp, "// largest block size, tags included, in each class; blocks larger\n");
+    fprintf(fp, "// than the last bound also go in the last class\n");
+    fprintf(fp, "static const size_t mm_class_size[MM_NUM_CLASSES] = {");
+    for (j = 0; j < k; j++)
+        fprintf(fp, "%s%zu", (j % 8) ? ", " : (j ? ",\n    " : "\n    "),
+                bounds[j]);
+    fprintf(fp, "\n};\n\n");
+    fprintf(fp, "#endif  // MM_CLASSES_H_\n");
+    if (fp != stdout)
+        fclose(fp);
+
+    free(sizes);
+    free(cum_count);
+    free(cum_bytes);
+    free(best);
+    free(from);
+    exit(0);
+}
+
+/*
+ * count_trace - Add the block size of every request in a trace
+ */
+static void count_trace(char *path) {
+    trace_reader_t r;
+    traceop_t op;
+    char msg[MAXLINE + 64];
+    size_t payload;
+
+    if (trace_open(&r, path) < 0) {
+        sprintf(msg, "Could not open %.1000s", path);
+        app_error(msg);
+    }
+    while (trace_next(&r, &op)) {
+        if (op.type == FREE || op.size == 0)
+            continue;
+        /* the rounding in mm_malloc */
+        payload = (op.size <= 32) ? 32 :
+                  ((size_t)op.size + WORD_SIZE - 1) & ~(WORD_SIZE - 1);
+        add_size(payload + TAGS_SIZE);
+    }
+    trace_close(&r);
+}
+
+/* table_slot - The slot holding size, or the empty slot for it */
+static sizecount_t *table_slot(size_t size) {
+    size_t i = (size * 0x9E3779B97F4A7C15ULL >> 20) & table_mask;
+
+    while (table[i].size != 0 && table[i].size != size)
+        i = (i + 1) & table_mask;
+    return &table[i];
+}
+
+/*
+ * add_size - Count one request of a block size, doubling the table
+ *     when it is half full
+ */
+static void add_size(size_t size) {
+    sizecount_t *old = table, *e;
+    size_t i, oldsize = table_mask + 1;
+
+    if (table == NULL || 2 * (table_used + 1) > table_mask + 1) {
+        table_mask = old ? 2 * oldsize - 1 : 1023;
+        if ((table = calloc(table_mask + 1, sizeof(sizecount_t))) == NULL)
+            app_error("Out of memory");
+        for (i = 0; old && i < oldsize; i++)
+            if (old[i].size != 0)
+                *table_slot(old[i].size) = old[i];
+        free(old);
+    }
+
+    e = table_slot(size);
+    if (e->size == 0) {
+        e->size = size;
+        table_used++;
+    }
+    e->count++;
+}
+
+static int size_cmp(const void *a, const void *b) {
+    size_t x = ((const sizecount_t *)a)->size;
+    size_t y = ((const sizecount_t *)b)->size;
+    return (x > y) - (x < y);
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void) {
+    fprintf(stderr, "Usage: mdclasses [-h] [-k <classes>] [-o <file>] <tracefile>...\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h          Print this message.\n");
+    fprintf(stderr, "\t-k <n>      Use at most <n> size classes (16, at most 64).\n");
+    fprintf(stderr, "\t-o <file>   Write the header to <file> instead of stdout.\n");
+}
+
+/*
+ * app_error - Report an error and exit
+ */
+static void app_error(char *msg) {
+    fprintf(stderr, "mdclasses: %s\n", msg);
+    exit(1);
+}
@@ -0,0 +1,525 @@
+/*
+ * mdgen.c - Generate synthetic .rep traces for mdriver from
+ *     parameterized workload models.
+ *
+ * A trace is a sequence of phases. Each phase has its own request-size
+ * distribution, block lifetime policy, realloc behavior and target
+ * number of live blocks, so a single trace can shift between, e.g., a
+ * LIFO burst of small objects and a long-lived pool of large buffers.
+ * All randomness comes from a seeded xorshift generator, so the same
+ * seed and phases always produce the same trace.
+ *
+ * Every block still live at the end of the last phase is freed, so the
+ * traces are balanced like the -bal.rep traces in TRACEDIR.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <math.h>
+
+#define MAXLINE   1024 /* max string size */
+#define MAXPHASES   64 /* max number of -p phases */
+#define MAXCLASSES  64 /* max sizes in a fixed: distribution */
+
+/* Request-size distributions */
+typedef enum {SIZE_POWER, SIZE_BIMODAL, SIZE_FIXED, SIZE_UNIFORM} size_model_t;
+
+/* Policies for picking which live block to free next */
+typedef enum {LIFE_LIFO, LIFE_FIFO, LIFE_RANDOM, LIFE_LONG} life_model_t;
+
+/* Parameters of one phase of the trace */
+typedef struct {
+    long ops;              /* number of requests in this phase */
+    long live;             /* target number of live blocks */
+    size_model_t size;     /* request-size distribution... */
+    double lo, hi, param;  /* ... and its parameters */
+    size_t classes[MAXCLASSES]; /* sizes for SIZE_FIXED */
+    int nclasses;
+    life_model_t life;     /* lifetime policy */
+    double longfrac;       /* fraction of long-lived blocks (LIFE_LONG) */
+    double realloc_pct;    /* percent of requests that grow a block */
+    double grow;           /* growth factor of each realloc */
+    size_t cap;            /* a block that would grow past this is freed */
+} phase_t;
+
+/* One generated request */
+typedef struct {
+    char type;             /* 'a', 'r', or 'f' */
+    long id;
+    size_t size;
+} op_t;
+
+/* The generated trace */
+static op_t *ops = NULL;
+static long num_ops = 0, max_ops = 0;
+static long num_ids = 0;
+static size_t live_bytes = 0, peak_bytes = 0;
+
+/*
+ * The live set. Blocks that may be freed are kept both in allocation
+ * order (a doubly linked list over ids, for LIFO and FIFO) and in a
+ * dense array (for picking one uniformly at random). Long-lived blocks
+ * are only counted; they are freed at the end of the trace.
+ */
+static long *next_id = NULL, *prev_id = NULL; /* allocation-order list */
+static long list_head = -1, list_tail = -1;
+static long *pool = NULL, *pool_pos = NULL;   /* dense array and positions */
+static long pool_size = 0;
+static size_t *sizes = NULL;                  /* current size of each id */
+static char *immortal = NULL;                 /* 1 if id is long-lived */
+static long num_immortal = 0;
+static long max_ids = 0;
+
+/* Function prototypes */
+static void parse_phase(char *spec, phase_t *phase);
+static void run_phase(phase_t *phase);
+static void finish(void);
+static void write_trace(FILE *fp);
+static size_t draw_size(phase_t *phase);
+static void usage(void);
+static void app_error(char *msg);
+
+/*********************
+ * Random number generation
+ *********************/
+
+static unsigned long long rng_state = 88172645463325252ULL;
+
+/* rng_seed - Start the generator from seed (any value, including 0) */
+static void rng_seed(unsigned long long seed) {
+    rng_state = seed * 2685821657736338717ULL + 88172645463325252ULL;
+    if (rng_state == 0)
+        rng_state = 88172645463325252ULL;
+}
+
+/* rng_next - Return the next 64 random bits (xorshift64*) */
+static unsigned long long rng_next(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ULL;
+}
+
+/* rng_uniform - Return a double uniformly distributed in [0, 1) */
+static double rng_uniform(void) {
+    return (rng_next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* rng_below - Return a long uniformly distributed in [0, n) */
+static long rng_below(long n) {
+    return (long)(rng_next() % (unsigned long long)n);
+}
+
+/**************
+ * Main routine
+ **************/
+int main(int argc, char **argv) {
+    phase_t phases[MAXPHASES];
+    int num_phases = 0;
+    char *outfile = NULL;
+    FILE *fp = stdout;
+    int i;
+    char c;
+
+    rng_seed(1);
+    while ((c = getopt(argc, argv, "s:o:p:h")) != EOF) {
+        switch (c) {
+        case 's': /* Random seed */
+            rng_seed(strtoull(optarg, NULL, 0));
+            break;
+        case 'o': /* Output file */
+            outfile = optarg;
+            break;
+        case 'p': /* Add a phase */
+            if (num_phases == MAXPHASES)
+                app_error("Too many phases");
+            parse_phase(optarg, &phases[num_phases++]);
+            break;
+        case 'h': /* Print this message */
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+
+    /* With no -p, generate a single phase with the default model */
+    if (num_phases == 0)
+        parse_phase("", &phases[num_phases++]);
+
+    for (i = 0; i < num_phases; i++)
+        run_phase(&phases[i]);
+    finish();
+
+    if (outfile != NULL && (fp = fopen(outfile, "w")) == NULL) {
+        perror(outfile);
+        exit(1);
+    }
+    write_trace(fp);
+    if (fp != stdout)
+        fclose(fp);
+    exit(0);
+}
+
+/*******************************************************
+ * The following routines parse the phase descriptions
+ *******************************************************/
+
+/*
+ * parse_phase - Fill in phase from a spec like
+ *     "ops=100000,live=2000,size=power:16:8192:1.5,life=lifo,realloc=5"
+ *     Keys that are not given keep their defaults.
+ */
+static void parse_phase(char *spec, phase_t *phase) {
+    char buf[MAXLINE];
+    char msg[MAXLINE + 64];
+    char *key, *val, *tok, *save = NULL;
+
+    phase->ops = 10000;
+    phase->live = 1000;
+    phase->size = SIZE_POWER;
+    phase->lo = 8;
+    phase->hi = 4096;
+    phase->param = 1.5;
+    phase->nclasses = 0;
+    phase->life = LIFE_RANDOM;
+    phase->longfrac = 0.1;
+    phase->realloc_pct = 0;
+    phase->grow = 2.0;
+    phase->cap = 1 << 20;
+
+    strncpy(buf, spec, MAXLINE - 1);
+    buf[MAXLINE - 1] = '\0';
+    for (key = strtok_r(buf, ",", &save); key != NULL;
+            key = strtok_r(NULL, ",", &save)) {
+        if ((val = strchr(key, '=')) == NULL) {
+            sprintf(msg, "Missing '=' in phase option \"%s\"", key);
+            app_error(msg);
+        }
+        *val++ = '\0';
+
+        if (!strcmp(key, "ops"))
+            phase->ops = atol(val);
+        else if (!strcmp(key, "live"))
+            phase->live = atol(val);
+        else if (!strcmp(key, "realloc"))
+            phase->realloc_pct = atof(val);
+        else if (!strcmp(key, "grow"))
+            phase->grow = atof(val);
+        else if (!strcmp(key, "cap"))
+            phase->cap = strtoul(val, NULL, 0);
+        else if (!strcmp(key, "long"))
+            phase->longfrac = atof(val);
+        else if (!strcmp(key, "life")) {
+            if (!strcmp(val, "lifo"))
+                phase->life = LIFE_LIFO;
+            else if (!strcmp(val, "fifo"))
+                phase->life = LIFE_FIFO;
+            else if (!strcmp(val, "random"))
+                phase->life = LIFE_RANDOM;
+            else if (!strcmp(val, "long"))
+                phase->life = LIFE_LONG;
+            else {
+                sprintf(msg, "Unknown lifetime model \"%s\"", val);
+                app_error(msg);
+            }
+        }
+        else if (!strcmp(key, "size")) {
+            tok = strtok(val, ":");
+            if (tok != NULL && !strcmp(tok, "fixed")) {
+                phase->size = SIZE_FIXED;
+                while ((tok = strtok(NULL, ":")) != NULL &&
+                        phase->nclasses < MAXCLASSES)
+                    phase->classes[phase->nclasses++] = strtoul(tok, NULL, 0);
+                if (phase->nclasses == 0)
+                    app_error("size=fixed needs at least one size");
+                continue;
+            }
+            if (tok != NULL && !strcmp(tok, "power"))
+                phase->size = SIZE_POWER;
+            else if (tok != NULL && !strcmp(tok, "bimodal"))
+                phase->size = SIZE_BIMODAL;
+            else if (tok != NULL && !strcmp(tok, "uniform"))
+                phase->size = SIZE_UNIFORM;
+            else {
+                sprintf(msg, "Unknown size model \"%s\"", tok ? tok : "");
+                app_error(msg);
+            }
+            if ((tok = strtok(NULL, ":")) != NULL)
+                phase->lo = atof(tok);
+            if ((tok = strtok(NULL, ":")) != NULL)
+                phase->hi = atof(tok);
+            if ((tok = strtok(NULL, ":")) != NULL)
+                phase->param = atof(tok);
+        }
+        else {
+            sprintf(msg, "Unknown phase option \"%s\"", key);
+            app_error(msg);
+        }
+    }
+
+    if (phase->lo < 1 || phase->hi < phase->lo)
+        app_error("Size bounds must satisfy 1 <= lo <= hi");
+    if (phase->live < 1)
+        app_error("live must be at least 1");
+}
+
+/*
+ * draw_size - Draw a request size from the phase's size distribution
+ *     power:lo:hi:alpha   bounded power law, P(s) ~ s^-alpha
+ *     bimodal:lo:hi:p     lo bytes, or hi bytes with probability p
+ *     fixed:s1:s2:...     one of the listed sizes, uniformly
+ *     uniform:lo:hi       uniform between lo and hi
+ */
+static size_t draw_size(phase_t *phase) {
+    double u = rng_uniform();
+    double a, x;
+
+    switch (phase->size) {
+    case SIZE_POWER:
+        a = 1.0 - phase->param;
+        if (fabs(a) < 1e-9)  /* alpha == 1: log-uniform */
+            x = phase->lo * pow(phase->hi / phase->lo, u);
+        else
+            x = pow(pow(phase->lo, a) +
+                    u * (pow(phase->hi, a) - pow(phase->lo, a)), 1.0 / a);
+        return (size_t)x;
+    case SIZE_BIMODAL:
+        return (size_t)((u < phase->param) ? phase->hi : phase->lo);
+    case SIZE_FIXED:
+        return phase->classes[rng_below(phase->nclasses)];
+    case SIZE_UNIFORM:
+    default:
+        return (size_t)(phase->lo + u * (phase->hi - phase->lo + 1));
+    }
+}
+
+/*******************************************
+ * The following routines build the trace
+ *******************************************/
+
+/*
+ * add_op - Append one request to the trace
+ */
+static void add_op(char type, long id, size_t size) {
+    if (num_ops == max_ops) {
+        max_ops = max_ops ? 2 * max_ops : 4096;
+        if ((ops = realloc(ops, max_ops * sizeof(op_t))) == NULL)
+            app_error("realloc failed in add_op");
+    }
+    ops[num_ops].type = type;
+    ops[num_ops].id = id;
+    ops[num_ops].size = size;
+    num_ops++;
+}
+
+/*
+ * new_id - Return a fresh block id, growing the per-id arrays
+ */
+static long new_id(void) {
+    if (num_ids == max_ids) {
+        max_ids = max_ids ? 2 * max_ids : 4096;
+        next_id = realloc(next_id, max_ids * sizeof(long));
+        prev_id = realloc(prev_id, max_ids * sizeof(long));
+        pool = realloc(pool, max_ids * sizeof(long));
+        pool_pos = realloc(pool_pos, max_ids * sizeof(long));
+        sizes = realloc(sizes, max_ids * sizeof(size_t));
+        immortal = realloc(immortal, max_ids);
+        if (!next_id || !prev_id || !pool || !pool_pos || !sizes || !immortal)
+            app_error("realloc failed in new_id");
+    }
+    return num_ids++;
+}
+
+/*
+ * live_insert - Make id freeable: append it to the allocation-order
+ *     list and to the dense pool
+ */
+static void live_insert(long id) {
+    next_id[id] = -1;
+    prev_id[id] = list_tail;
+    if (list_tail >= 0)
+        next_id[list_tail] = id;
+    else
+        list_head = id;
+    list_tail = id;
+
+    pool_pos[id] = pool_size;
+    pool[pool_size++] = id;
+}
+
+/*
+ * live_remove - Remove id from the list and the pool
+ */
+static void live_remove(long id) {
+    long last;
+
+    if (prev_id[id] >= 0)
+        next_id[prev_id[id]] = next_id[id];
+    else
+        list_head = next_id[id];
+    if (next_id[id] >= 0)
+        prev_id[next_id[id]] = prev_id[id];
+    else
+        list_tail = prev_id[id];
+
+    last = pool[--pool_size];
+    pool[pool_pos[id]] = last;
+    pool_pos[last] = pool_pos[id];
+}
+
+/*
+ * pick_victim - Choose the live block to free under the phase's
+ *     lifetime policy
+ */
+static long pick_victim(phase_t *phase) {
+    switch (phase->life) {
+    case LIFE_LIFO:
+        return list_tail;
+    case LIFE_FIFO:
+        return list_head;
+    default:
+        return pool[rng_below(pool_size)];
+    }
+}
+
+/*
+ * do_alloc, do_free, do_realloc - Emit one request and update the
+ *     live set and byte counts
+ */
+static void do_alloc(phase_t *phase) {
+    long id = new_id();
+    size_t size = draw_size(phase);
+
+    if (size == 0)
+        size = 1;
+    sizes[id] = size;
+    immortal[id] = (phase->life == LIFE_LONG &&
+                    rng_uniform() < phase->longfrac);
+    if (immortal[id])
+        num_immortal++;
+    else
+        live_insert(id);
+    add_op('a', id, size);
+    live_bytes += size;
+    if (live_bytes > peak_bytes)
+        peak_bytes = live_bytes;
+}
+
+static void do_free(long id) {
+    live_remove(id);
+    add_op('f', id, 0);
+    live_bytes -= sizes[id];
+}
+
+static void do_realloc(phase_t *phase) {
+    long id = pick_victim(phase);
+    size_t size = (size_t)(sizes[id] * phase->grow);
+
+    /* End the chain once the block outgrows the cap */
+    if (size > phase->cap) {
+        do_free(id);
+        return;
+    }
+    if (size == 0)
+        size = 1;
+    add_op('r', id, size);
+    live_bytes += size - sizes[id];
+    sizes[id] = size;
+    if (live_bytes > peak_bytes)
+        peak_bytes = live_bytes;
+}
+
+/*
+ * run_phase - Emit phase->ops requests. Allocation is chosen with
+ *     probability 1 - live/(2*target), so the number of freeable live
+ *     blocks hovers around the phase's target.
+ */
+static void run_phase(phase_t *phase) {
+    long i;
+    double p_alloc;
+
+    for (i = 0; i < phase->ops; i++) {
+        if (pool_size > 0 && rng_uniform() * 100 < phase->realloc_pct) {
+            do_realloc(phase);
+            continue;
+        }
+        p_alloc = 1.0 - (double)pool_size / (2.0 * phase->live);
+        if (pool_size == 0 || rng_uniform() < p_alloc)
+            do_alloc(phase);
+        else
+            do_free(pick_victim(phase));
+    }
+}
+
+/*
+ * finish - Free every block that is still live, oldest first, so the
+ *     trace ends with an empty heap
+ */
+static void finish(void) {
+    long id;
+
+    for (id = 0; id < num_ids; id++) {
+        if (immortal[id]) {
+            add_op('f', id, 0);
+            live_bytes -= sizes[id];
+        }
+    }
+    while (list_head >= 0)
+        do_free(list_head);
+}
+
+/*
+ * write_trace - Write the trace in the .rep format read by mdriver:
+ *     a header of suggested heap size, number of ids, number of ops
+ *     and weight, followed by one request per line
+ */
+static void write_trace(FILE *fp) {
+    long i;
+
+    fprintf(fp, "%zu\n%ld\n%ld\n%d\n", peak_bytes, num_ids, num_ops, 1);
+    for (i = 0; i < num_ops; i++) {
+        if (ops[i].type == 'f')
+            fprintf(fp, "f %ld\n", ops[i].id);
+        else
+            fprintf(fp, "%c %ld %zu\n", ops[i].type, ops[i].id, ops[i].size);
+    }
+}
+
+/*************************************
+ * Some miscellaneous helper routines
+ ************************************/
+
+/*
+ * app_error - Report an arbitrary application error
+ */
+static void app_error(char *msg) {
+    fprintf(stderr, "mdgen: %s\n", msg);
+    exit(1);
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void) {
+    fprintf(stderr, "Usage: mdgen [-h] [-s <seed>] [-o <file>] [-p <phase>]...\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h          Print this message.\n");
+    fprintf(stderr, "\t-o <file>   Write the trace to <file> instead of stdout.\n");
+    fprintf(stderr, "\t-p <phase>  Append a phase (repeatable). A phase is a comma\n");
+    fprintf(stderr, "\t            separated list of key=value settings:\n");
+    fprintf(stderr, "\t  ops=<n>         requests in the phase (10000)\n");
+    fprintf(stderr, "\t  live=<n>        target number of live blocks (1000)\n");
+    fprintf(stderr, "\t  size=power:<lo>:<hi>:<alpha>   bounded power law (8:4096:1.5)\n");
+    fprintf(stderr, "\t  size=bimodal:<small>:<large>:<p>  large with probability p\n");
+    fprintf(stderr, "\t  size=fixed:<s1>:<s2>:...        one of a fixed set of sizes\n");
+    fprintf(stderr, "\t  size=uniform:<lo>:<hi>\n");
+    fprintf(stderr, "\t  life=lifo|fifo|random|long      which block to free (random)\n");
+    fprintf(stderr, "\t  long=<f>        fraction kept to the end for life=long (0.1)\n");
+    fprintf(stderr, "\t  realloc=<pct>   percent of requests that realloc a block (0)\n");
+    fprintf(stderr, "\t  grow=<factor>   size factor applied by each realloc (2.0)\n");
+    fprintf(stderr, "\t  cap=<bytes>     free a block instead of growing it past this (1M)\n");
+    fprintf(stderr, "\t-s <seed>   Seed for the random number generator (1).\n");
+}
@@ -0,0 +1,475 @@
+/*
+ * mdrecord.c - Record the allocations of an unmodified program as a trace.
+ *
+ * Built into libmmrecord.so, which wraps malloc, calloc, realloc, free
+ * and the aligned allocators around glibc's own (__libc_malloc and
+ * friends):
+ *
+ *     MM_RECORD_FILE=ls.rep LD_PRELOAD=./libmmrecord.so ls -l
+ *     ./mdriver -f ls.rep
+ *
+ * Each call appends a fixed-size binary record (a global sequence
+ * number, the pointers involved and the size) to a buffer owned by the
+ * calling thread, so the common path takes no lock. Full buffers are
+ * appended to <file>.raw. At exit the records are sorted back into
+ * sequence order, each allocation is given a fresh trace id, and the
+ * trace is written in the .rep format read by mdriver, with the peak
+ * live bytes, num_ids and num_ops filled into the header.
+ *
+ * The output defaults to mmrecord.<pid>.rep; a "%p" in MM_RECORD_FILE is
+ * replaced by the pid so that programs which exec others record each
+ * process to its own file. Children that fork without exec stop
+ * recording.
+ *
+ * Sequence numbers are taken before a free and after an allocation
+ * returns, so an address is never seen reused before it was freed,
+ * except when a realloc races with another thread. The replay tolerates
+ * that: an address that comes back while still live is freed first, and
+ * frees of unknown pointers (allocated before recording started, or by
+ * valloc) are dropped.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* glibc's allocator, under the names it exports for wrappers like us */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void *ptr);
+
+#define BUF_RECORDS 8192   /* records per thread buffer */
+#define MAXPATH     1024
+
+/* One intercepted call */
+typedef struct {
+    uint64_t seq;          /* global order of the call */
+    uintptr_t ptr;         /* block returned, or freed */
+    uintptr_t old;         /* block passed to realloc */
+    uint64_t size;         /* requested size */
+    char type;             /* 'a', 'r' or 'f' */
+} record_t;
+
+/* A thread's record buffer. Buffers are never unmapped; a buffer whose
+   thread has exited is reused by the next new thread. */
+typedef struct recbuf {
+    struct recbuf *next;   /* list of all buffers */
+    int in_use;            /* owned by a live thread */
+    int count;             /* records in recs */
+    record_t recs[BUF_RECORDS];
+} recbuf_t;
+
+static int recording = 0;              /* set once init succeeded */
+static pid_t record_pid;               /* the process being recorded */
+static uint64_t next_seq = 0;
+static int raw_fd = -1;
+static char rep_path[MAXPATH];
+static char raw_path[MAXPATH + 8];
+
+static pthread_mutex_t buf_lock = PTHREAD_MUTEX_INITIALIZER;
+static recbuf_t *buffers = NULL;       /* protected by buf_lock */
+static pthread_key_t buf_key;
+
+static __thread recbuf_t *my_buf = NULL;
+static __thread int in_rec = 0;        /* don't record our own calls */
+
+/*****************************************
+ * Recording
+ ****************************************/
+
+/*
+ * flush_buf - Append a buffer's records to the raw file
+ */
+static void flush_buf(recbuf_t *buf) {
+    char *p = (char *)buf->recs;
+    size_t left = buf->count * sizeof(record_t);
+    ssize_t n;
+
+    pthread_mutex_lock(&buf_lock);
+    while (left > 0 && (n = write(raw_fd, p, left)) > 0) {
+        p += n;
+        left -= n;
+    }
+    pthread_mutex_unlock(&buf_lock);
+    buf->count = 0;
+}
+
+/*
+ * release_buf - Thread exit: flush the buffer and hand it back
+ */
+static void release_buf(void *arg) {
+    recbuf_t *buf = arg;
+
+    flush_buf(buf);
+    pthread_mutex_lock(&buf_lock);
+    buf->in_use = 0;
+    pthread_mutex_unlock(&buf_lock);
+}
+
+/*
+ * get_buf - Return this thread's buffer, claiming one on first use
+ */
+static recbuf_t *get_buf(void) {
+    recbuf_t *buf;
+
+    if (my_buf != NULL)
+        return my_buf;
+
+    pthread_mutex_lock(&buf_lock);
+    for (buf = buffers; buf != NULL && buf->in_use; buf = buf->next)
+        ;
+    if (buf == NULL) {
+        buf = mmap(NULL, sizeof(recbuf_t), PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (buf == MAP_FAILED) {
+            pthread_mutex_unlock(&buf_lock);
+            return NULL;
+        }
+        buf->next = buffers;
+        buffers = buf;
+    }
+    buf->in_use = 1;
+    buf->count = 0;
+    pthread_mutex_unlock(&buf_lock);
+
+    my_buf = buf;
+    pthread_setspecific(buf_key, buf);
+    return buf;
+}
+
+/*
+ * record - Log one call. seq is taken here, so callers order the call
+ *     relative to the libc operation by calling us before or after it.
+ */
+static void record(char type, void *ptr, void *old, size_t size) {
+    recbuf_t *buf;
+    record_t *r;
+
+    in_rec = 1;
+    if ((buf = get_buf()) != NULL) {
+        r = &buf->recs[buf->count];
+        r->seq = __sync_fetch_and_add(&next_seq, 1);
+        r->ptr = (uintptr_t)ptr;
+        r->old = (uintptr_t)old;
+        r->size = size;
+        r->type = type;
+        if (++buf->count == BUF_RECORDS)
+            flush_buf(buf);
+    }
+    in_rec = 0;
+}
+
+static int active(void) {
+    return recording && !in_rec;
+}
+
+/*
+ * record_child - A forked child shares the parent's raw file and a copy
+ *     of its buffers; it must not add to either
+ */
+static void record_child(void) {
+    recording = 0;
+}
+
+/*
+ * record_init - Pick the output files and start recording
+ */
+__attribute__((constructor))
+static void record_init(void) {
+    char *env = getenv("MM_RECORD_FILE");
+    char *s, *d = rep_path;
+
+    record_pid = getpid();
+    if (env == NULL)
+        env = "mmrecord.%p.rep";
+    for (s = env; *s && d < rep_path + MAXPATH - 24; s++) {
+        if (s[0] == '%' && s[1] == 'p') {
+            d += sprintf(d, "%d", (int)record_pid);
+            s++;
+        } else
+            *d++ = *s;
+    }
+    *d = '\0';
+    sprintf(raw_path, "%s.raw", rep_path);
+
+    raw_fd = open(raw_path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC,
+                  0644);
+    if (raw_fd < 0) {
+        perror(raw_path);
+        return;
+    }
+    if (pthread_key_create(&buf_key, release_buf) != 0)
+        return;
+    pthread_atfork(NULL, NULL, record_child);
+    recording = 1;
+}
+
+/*****************************************
+ * Replay of the records into a trace
+ ****************************************/
+
+/* The live blocks, an open-addressing table keyed by address */
+typedef struct {
+    uintptr_t ptr;         /* 0 if the slot is empty */
+    long id;
+    size_t size;
+} live_t;
+
+static live_t *live = NULL;
+static size_t live_mask = 0;           /* table size - 1 */
+static size_t live_count = 0;
+
+static size_t live_hash(uintptr_t p) {
+    return (size_t)(((p >> 4) * 0x9E3779B97F4A7C15ULL) >> 17) & live_mask;
+}
+
+static live_t *live_find(uintptr_t p) {
+    size_t i;
+
+    if (live == NULL)
+        return NULL;
+    for (i = live_hash(p); live[i].ptr != 0; i = (i + 1) & live_mask)
+        if (live[i].ptr == p)
+            return &live[i];
+    return NULL;
+}
+
+static void live_insert(uintptr_t p, long id, size_t size);
+
+static void live_grow(void) {
+    live_t *old = live;
+    size_t i, oldsize = live_mask + 1;
+
+    live_mask = old ? 2 * oldsize - 1 : 4095;
+    live = __libc_calloc(live_mask + 1, sizeof(live_t));
+    if (live == NULL) {
+        fprintf(stderr, "mdrecord: out of memory\n");
+        exit(1);
+    }
+    live_count = 0;
+    for (i = 0; old && i < oldsize; i++)
+        if (old[i].ptr != 0)
+            live_insert(old[i].ptr, old[i].id, old[i].size);
+    __libc_free(old);
+}
+
+static void live_insert(uintptr_t p, long id, size_t size) {
+    size_t i;
+
+    if (live == NULL || 2 * (live_count + 1) > live_mask + 1)
+        live_grow();
+    for (i = live_hash(p); live[i].ptr != 0; i = (i + 1) & live_mask)
+        ;
+    live[i].ptr = p;
+    live[i].id = id;
+    live[i].size = size;
+    live_count++;
+}
+
+/*
+ * live_remove - Delete a slot, shifting later entries of its probe run
+ *     back so lookups never stop at a hole
+ */
+static void live_remove(live_t *e) {
+    size_t i = e - live, j = i, k;
+
+    live[i].ptr = 0;
+    for (;;) {
+        j = (j + 1) & live_mask;
+        if (live[j].ptr == 0)
+            break;
+        k = live_hash(live[j].ptr);
+        /* leave j alone if its home slot lies cyclically in (i, j] */
+        if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j))
+            continue;
+        live[i] = live[j];
+        live[j].ptr = 0;
+        i = j;
+    }
+    live_count--;
+}
+
+static int seq_cmp(const void *a, const void *b) {
+    uint64_t x = ((const record_t *)a)->seq, y = ((const record_t *)b)->seq;
+    return (x > y) - (x < y);
+}
+
+/*
+ * replay - Turn n records, in sequence order, into trace ops on fp.
+ *     Returns the number of ops; sets *num_ids and *peak.
+ */
+static long replay(record_t *recs, size_t n, FILE *fp, long *num_ids,
+                   size_t *peak) {
+    size_t i, size, bytes = 0;
+    long ops = 0, id;
+    live_t *e;
+
+    *num_ids = 0;
+    *peak = 0;
+    for (i = 0; i < n; i++) {
+        record_t *r = &recs[i];
+        size = r->size ? r->size : 1;   /* mm_malloc(0) returns NULL */
+
+        if (r->type == 'f') {
+            if ((e = live_find(r->ptr)) != NULL) {
+                fprintf(fp, "f %ld\n", e->id);
+                bytes -= e->size;
+                live_remove(e);
+                ops++;
+            }
+            continue;
+        }
+
+        /* A realloc of a block we never saw is a fresh allocation */
+        id = -1;
+        if (r->type == 'r' && (e = live_find(r->old)) != NULL) {
+            id = e->id;
+            bytes -= e->size;
+            live_remove(e);
+        }
+
+        /* The address was handed out again before we saw its free */
+        if ((e = live_find(r->ptr)) != NULL) {
+            fprintf(fp, "f %ld\n", e->id);
+            bytes -= e->size;
+            live_remove(e);
+            ops++;
+        }
+
+        if (id < 0) {
+            id = (*num_ids)++;
+            fprintf(fp, "a %ld %zu\n", id, size);
+        } else
+            fprintf(fp, "r %ld %zu\n", id, size);
+        live_insert(r->ptr, id, size);
+        bytes += size;
+        if (bytes > *peak)
+            *peak = bytes;
+        ops++;
+    }
+    return ops;
+}
+
+/*
+ * record_fini - Stop recording, flush every buffer and write the trace
+ */
+__attribute__((destructor))
+static void record_fini(void) {
+    recbuf_t *buf;
+    record_t *recs;
+    struct stat st;
+    size_t n, peak;
+    long ops, num_ids;
+    FILE *fp;
+
+    if (!recording || getpid() != record_pid)
+        return;
+    recording = 0;
+    for (buf = buffers; buf != NULL; buf = buf->next)
+        flush_buf(buf);
+
+    if (fstat(raw_fd, &st) < 0 || (n = st.st_size / sizeof(record_t)) == 0) {
+        close(raw_fd);
+        unlink(raw_path);
+        return;
+    }
+    close(raw_fd);
+    if ((raw_fd = open(raw_path, O_RDONLY)) < 0 ||
+        (recs = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                     raw_fd, 0)) == MAP_FAILED) {
+        perror(raw_path);
+        return;
+    }
+    qsort(recs, n, sizeof(record_t), seq_cmp);
+
+    if ((fp = fopen(rep_path, "w")) == NULL) {
+        perror(rep_path);
+        return;
+    }
+    /* Leave room for the header, which needs the totals */
+    fprintf(fp, "%20d\n%20d\n%20d\n%20d\n", 0, 0, 0, 0);
+    ops = replay(recs, n, fp, &num_ids, &peak);
+    rewind(fp);
+    fprintf(fp, "%20zu\n%20ld\n%20ld\n%20d\n", peak, num_ids, ops, 1);
+    fclose(fp);
+
+    munmap(recs, st.st_size);
+    close(raw_fd);
+    unlink(raw_path);
+}
+
+/*************************************
+ * The standard allocation interface
+ ************************************/
+
+void *malloc(size_t size) {
+    void *p = __libc_malloc(size);
+
+    if (active() && p != NULL)
+        record('a', p, NULL, size);
+    return p;
+}
+
+void *calloc(size_t nmemb, size_t size) {
+    void *p = __libc_calloc(nmemb, size);
+
+    if (active() && p != NULL)
+        record('a', p, NULL, nmemb * size);
+    return p;
+}
+
+void *realloc(void *ptr, size_t size) {
+    void *p;
+
+    if (!active())
+        return __libc_realloc(ptr, size);
+    if (ptr == NULL)
+        return malloc(size);
+    if (size == 0) {
+        free(ptr);
+        return NULL;
+    }
+    if ((p = __libc_realloc(ptr, size)) != NULL)
+        record('r', p, ptr, size);
+    return p;
+}
+
+void free(void *ptr) {
+    if (ptr == NULL)
+        return;
+    if (active())
+        record('f', ptr, NULL, 0);
+    __libc_free(ptr);
+}
+
+void *memalign(size_t alignment, size_t size) {
+    void *p = __libc_memalign(alignment, size);
+
+    if (active() && p != NULL)
+        record('a', p, NULL, size);
+    return p;
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    return memalign(alignment, size);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size) {
+    void *p;
+
+    if (alignment < sizeof(void *) || (alignment & (alignment - 1)) != 0)
+        return EINVAL;
+    if ((p = memalign(alignment, size)) == NULL)
+        return ENOMEM;
+    *memptr = p;
+    return 0;
+}
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE /* for sched_setaffinity */
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -5,11 +6,21 @@
 #include <string.h>
 #include <assert.h>
 #include <float.h>
+#include <math.h>
 #include <time.h>
+#include <sched.h>
+#include <sys/utsname.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 
 #include "mm.h"
 #include "memlib.h"
 #include "fsecs.h"
+#include "fcyc.h"
+#include "perfctr.h"
+#include "trace.h"
+#include "backend.h"
 #include "config.h"
 
 /**********************
@@ -20,6 +31,9 @@
 #define MAXLINE     1024 /* max string size */
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
+#define SCALING_MIN ((size_t)1 << 20) /* first block size for -Z scaling */
+#define SCALING_STEPS 10 /* doublings from there, up to 1 GB */
+#define SCALING_RUNS   3 /* chains of doublings timed, keeping the best */
 
 /* Returns true if p is ALIGNMENT-byte aligned */
 #define IS_ALIGNED(p)  ((((unsigned long)(p)) % ALIGNMENT) == 0)
@@ -35,25 +49,6 @@ typedef struct range_t {
     struct range_t *next;  /* next list element */
 } range_t;
 
-/* Characterizes a single trace operation (allocator request) */
-typedef struct {
-    enum {ALLOC, FREE, REALLOC} type; /* type of request */
-    int index;                        /* index for free() to use later */
-    int size;                         /* byte size of alloc/realloc request */
-} traceop_t;
-
-/* Holds the information for one trace file*/
-typedef struct {
-    char trace_name[1024];
-    int sugg_heapsize;   /* suggested heap size (unused) */
-    int num_ids;         /* number of alloc/realloc ids */
-    int num_ops;         /* number of distinct requests */
-    int weight;          /* weight for this trace (unused) */
-    traceop_t *ops;      /* array of requests */
-    char **blocks;       /* array of ptrs returned by malloc/realloc... */
-    size_t *block_sizes; /* ... and a corresponding array of payload sizes */
-} trace_t;
-
 /*
  * Holds the params to the xxx_speed functions, which are timed by fcyc.
  * This struct is necessary because fcyc accepts only a pointer array
@@ -62,6 +57,8 @@ typedef struct {
 typedef struct {
     trace_t *trace;
     range_t *ranges;
+    char **addrs;    /* if set, eval_mm_speed records each op's payload */
+    int num_ops;     /* if set, eval_mm_speed stops after this many ops */
 } speed_t;
 
 /* Summarizes the important stats for some malloc function on some trace */
@@ -70,12 +67,46 @@ typedef struct {
     double ops;      /* number of ops (malloc/free/realloc) in the trace */
     int valid;       /* was the trace processed correctly by the allocator? */
     double secs;     /* number of secs needed to run the trace */
+    double secs_sd;  /* standard deviation of the timed samples */
+    int samples;     /* number of timed samples behind secs */
+    double touch_secs; /* part of secs spent only writing payloads (-A) */
+
+    /* the first timed run on its own, and the page faults taken by it
+       and by a run once timing is done (-F) */
+    double first_secs;
+    double first_faults;
+    double steady_faults;
+
+    /* rebuilding the heap at its peak by replaying the trace up to
+       there, against restoring a snapshot of it, and the size of the
+       snapshot (-X) */
+    int peak_op;
+    double rebuild_secs;
+    double restore_secs;
+    double snapshot_bytes;
 
     char trace_name[1024];
+    double weight;   /* weight in the composite scores (header or -w) */
 
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
 
+    /* hardware events for one speed run (-p), -1 where unavailable */
+    double counters[PERFCTR_NUM];
+
+    /* peak heap size, and the bytes of it on huge pages (-P) and
+       resident (-D), after the speed run */
+    double heap_bytes;
+    double huge_bytes;
+    double resident_bytes;
+
+    /* mm throughput over libc's on the same trace, 0 if either failed */
+    double libc_ratio;
+
+    /* per-op latency percentiles in ns, measured only with -B */
+    double p50_ns;
+    double p99_ns;
+
     /* Note: secs and util are only defined if valid is true */
 } stats_t;
 
@@ -84,6 +115,23 @@ typedef struct {
  *******************/
 int verbose = 0;        /* global flag for verbose output */
 static int errors = 0;  /* number of errs found when running student malloc */
+static int timeline = 0;/* sample a fragmentation timeline every n ops (-s) */
+static int perfcounters = 0; /* read hardware performance counters (-p) */
+static int split_touch = 0;  /* time payload writes on their own (-A) */
+static int latency = 0;      /* measure per-op latency (set by -B) */
+static int heap_hint = 0;    /* presize the heap from the trace (-H) */
+static char *heap_mode = "map"; /* how memlib backs the heap (-m) */
+static int hugepages = 0;    /* back the heap with huge pages (-P) */
+static char *prefault = NULL; /* prefault the heap: none, touch, lock (-F) */
+static int snapshot = 0;     /* time restoring a heap snapshot (-X) */
+static int release = 0;      /* set the page release threshold (-D) ... */
+static size_t release_threshold; /* ... to this many bytes */
+static int mmap_blocks = 0;  /* map blocks of their own (-Z) ... */
+static size_t mmap_threshold; /* ... at least this many bytes */
+static backend_t *be = &mm_backend; /* the allocator being evaluated */
+static char **weight_names = NULL;  /* traces reweighted by -w ... */
+static double *weight_values = NULL; /* ... and their new weights */
+static int num_weights = 0;
 char msg[MAXLINE];      /* for whenever we need to compose an error message */
 
 /* Directory where default tracefiles are found */
@@ -94,21 +142,22 @@ static char *default_tracefiles[] = {
     DEFAULT_TRACEFILES, NULL
 };
 
+/* The filenames of the large-heap tracefiles (-L) */
+static char *large_tracefiles[] = {
+    LARGE_TRACEFILES, NULL
+};
+
 
 /*********************
  * Function prototypes
  *********************/
 
 /* these functions manipulate range lists */
-static int add_range(range_t **ranges, char *lo, int size,
+static int add_range(range_t **ranges, char *lo, size_t size,
                      int tracenum, int opnum);
 static void remove_range(range_t **ranges, char *lo);
 static void clear_ranges(range_t **ranges);
 
-/* These functions read, allocate, and free storage for traces */
-static trace_t *read_trace(char *tracedir, char *filename);
-static void free_trace(trace_t *trace);
-
 /* Routines for evaluating the correctness and speed of libc malloc */
 static int eval_libc_valid(trace_t *trace, int tracenum);
 static void eval_libc_speed(void *ptr);
@@ -118,9 +167,52 @@ static void eval_libc_speed(void *ptr);
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
 static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
 static void eval_mm_speed(void *ptr);
+static void eval_touch_speed(void *ptr);
+static double eval_mm_once(speed_t *params, double *faults);
+static void eval_mm_latency(trace_t *trace, stats_t *stats);
+static void eval_mm_snapshot(trace_t *trace, int tracenum, stats_t *stats);
+static void eval_restore_speed(void *ptr);
+static void eval_realloc_scaling(size_t max_heap);
+static int be_init(trace_t *trace);
+static void init_heap(void);
+
+/* These functions run the mm checks on a whole trace file, either in
+   this process or in a pool of pinned worker processes */
+static void eval_mm_trace(char *tracefile, int tracenum, stats_t *stats);
+static void eval_mm_parallel(int n, char **tracefiles, stats_t *stats,
+                             int jobs);
+static int pick_cores(int *cores, int max);
+
+/* These functions record the fragmentation timeline of a trace */
+static FILE *timeline_open(trace_t *trace);
+static void timeline_sample(FILE *fp, int opnum, size_t live_bytes);
+
+/* Machine-readable output and baseline comparison */
+static void write_results(char *filename, int n, stats_t *stats);
+static void json_string(FILE *fp, const char *s);
+static void csv_field(FILE *fp, const char *s);
+static int csv_split(char *line, char **fields, int max);
+static int compare_baseline(char *filename, int n, stats_t *stats,
+                            double threshold);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static double ci95(double sd, int samples);
+static void printcounters(int n, stats_t *stats);
+static void printtouch(int n, stats_t *stats);
+static void printhuge(int n, stats_t *stats);
+static void printresident(int n, stats_t *stats);
+static void printfirst(int n, stats_t *stats);
+static void printsnapshot(int n, stats_t *stats);
+static void printratios(int n, stats_t *stats, stats_t *libc_stats);
+static void printbackends(int nb, backend_t **backends, int n,
+                          stats_t **stats);
+static double alloc_secs(stats_t *stats);
+static double trace_weight(char *tracefile, int header_weight);
+static void weighted_totals(int n, stats_t *stats, double *util,
+                            double *throughput);
+static int double_cmp(const void *a, const void *b);
+static size_t parse_bytes(char *s);
 static void usage(void);
 static void unix_error(char *msg);
 static void malloc_error(int tracenum, int opnum, char *msg);
@@ -130,27 +222,46 @@ static void app_error(char *msg);
  * Main routine
  **************/
 int main(int argc, char **argv) {
-    int i;
+    int i, j;
     char c;
     char **tracefiles = NULL;  /* null-terminated array of trace file names */
     int num_tracefiles = 0;    /* the number of traces in that array */
     trace_t *trace = NULL;     /* stores a single trace file in memory */
-    range_t *ranges = NULL;    /* keeps track of block extents for one trace */
     stats_t *libc_stats = NULL;/* libc stats for each trace */
     stats_t *mm_stats = NULL;  /* mm (i.e. student) stats for each trace */
     speed_t speed_params;      /* input parameters to the xx_speed routines */
 
-    int run_libc = 0;    /* If set, run libc malloc (set by -l) */
+    int show_libc = 0;   /* If set, print the libc results (set by -l) */
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
+    char *outfile = NULL;      /* write CSV/JSON results here (set by -o) */
+    char *baseline = NULL;     /* compare against this baseline (set by -b) */
+    double threshold = 5.0;    /* regression threshold in percent (set by -r) */
+    int regressions = 0;       /* number of regressions against baseline */
+    int jobs = 0;              /* worker processes for the mm traces (-j) */
+    backend_t **backends = NULL; /* mm first, then each -B allocator */
+    stats_t **backend_stats = NULL; /* stats of each backend per trace */
+    int num_backends = 1;
+    int mm_errors;
+
+    /* timing options; negative means keep the timing package's default */
+    int kbest = -1;            /* K in the K-best scheme (set by -k) */
+    double epsilon = -1;       /* K-best tolerance (set by -e) */
+    int samples = -1;          /* fcyc max samples / timer runs (set by -n) */
+    int cold_cache = -1;       /* clear the cache before each sample (-C) */
+    size_t heap_limit = 0;     /* simulated heap size limit (set by -S) */
+    int large = 0;             /* run the large-heap traces (set by -L) */
 
     /* temporaries used to compute the performance index */
-    double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
+    double avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
+    double libc_throughput;
+    double target = 0;   /* throughput for full credit (-R), 0 for libc's */
     int numcorrect;
+    char *eq;
 
     /*
      * Read and interpret the command line arguments
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF) {
+    while ((c = getopt(argc, argv, "f:t:o:b:r:s:j:T:k:e:n:C:B:w:R:S:m:D:F:Z:hvVgalpAHLPX")) != EOF) {
         switch (c) {
         case 'g': /* Generate summary info for the autograder */
             autograder = 1;
@@ -170,8 +281,136 @@ int main(int argc, char **argv) {
             if (tracedir[strlen(tracedir) - 1] != '/')
                 strcat(tracedir, "/"); /* path always ends with "/" */
             break;
-        case 'l': /* Run libc malloc */
-            run_libc = 1;
+        case 'o': /* Write machine-readable results to a file */
+            outfile = optarg;
+            break;
+        case 'b': /* Compare results against a saved baseline */
+            baseline = optarg;
+            break;
+        case 'r': /* Regression threshold (percent) for -b */
+            threshold = atof(optarg);
+            break;
+        case 's': /* Sample a fragmentation timeline every n ops */
+            timeline = atoi(optarg);
+            break;
+        case 'j': /* Run the mm traces in n pinned worker processes */
+            jobs = atoi(optarg);
+            break;
+        case 'T': /* Timing method */
+            if (!strcmp(optarg, "fcyc"))
+                set_fsecs_method(FSECS_FCYC);
+            else if (!strcmp(optarg, "itimer"))
+                set_fsecs_method(FSECS_ITIMER);
+            else if (!strcmp(optarg, "gettod"))
+                set_fsecs_method(FSECS_GETTOD);
+            else if (!strcmp(optarg, "clock"))
+                set_fsecs_method(FSECS_CLOCK);
+            else {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'k': /* K in the K-best scheme */
+            kbest = atoi(optarg);
+            break;
+        case 'e': /* K-best tolerance */
+            epsilon = atof(optarg);
+            break;
+        case 'n': /* Max samples (fcyc) or number of runs (other timers) */
+            samples = atoi(optarg);
+            break;
+        case 'C': /* Cold or warm cache for the fcyc samples */
+            if (!strcmp(optarg, "cold"))
+                cold_cache = 1;
+            else if (!strcmp(optarg, "warm"))
+                cold_cache = 0;
+            else {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'B': /* Compare against an allocator in a shared object */
+            if ((backends = realloc(backends, (num_backends + 1) *
+                                    sizeof(backend_t *))) == NULL)
+                unix_error("ERROR: realloc failed in main");
+            backends[0] = &mm_backend;
+            if ((backends[num_backends++] = backend_load(optarg)) == NULL)
+                exit(1);
+            latency = 1;
+            break;
+        case 'w': /* Override the weight of one trace */
+            if ((eq = strrchr(optarg, '=')) == NULL) {
+                usage();
+                exit(1);
+            }
+            *eq = '\0';
+            if ((weight_names = realloc(weight_names, (num_weights + 1) *
+                                        sizeof(char *))) == NULL ||
+                    (weight_values = realloc(weight_values, (num_weights + 1) *
+                                             sizeof(double))) == NULL)
+                unix_error("ERROR: realloc failed in main");
+            weight_names[num_weights] = optarg;
+            weight_values[num_weights++] = atof(eq + 1);
+            break;
+        case 'R': /* Throughput target for the perf index */
+            if (!strcmp(optarg, "libc"))
+                target = 0;
+            else if ((target = atof(optarg) * 1e3) <= 0) {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'S': /* Heap size limit */
+            if ((heap_limit = parse_bytes(optarg)) == 0) {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'F': /* Prefault the heap and time the first run apart */
+            if (strcmp(optarg, "none") && strcmp(optarg, "touch") &&
+                    strcmp(optarg, "lock")) {
+                usage();
+                exit(1);
+            }
+            prefault = optarg;
+            break;
+        case 'D': /* Release the pages of free blocks this big */
+            release_threshold = parse_bytes(optarg);
+            release = 1;
+            break;
+        case 'Z': /* Give blocks this big their own mapping */
+            mmap_threshold = parse_bytes(optarg);
+            mmap_blocks = 1;
+            break;
+        case 'm': /* How memlib backs the heap */
+            if (strcmp(optarg, "malloc") && strcmp(optarg, "map") &&
+                    strcmp(optarg, "reserve") && strcmp(optarg, "file")) {
+                usage();
+                exit(1);
+            }
+            heap_mode = optarg;
+            break;
+        case 'L': /* Use the large-heap traces */
+            large = 1;
+            break;
+        case 'H': /* Pass the suggested heap size to mm_init_hint */
+            heap_hint = 1;
+            break;
+        case 'A': /* Separate allocator time from payload-touch time */
+            split_touch = 1;
+            break;
+        case 'p': /* Read hardware performance counters */
+            perfcounters = 1;
+            break;
+        case 'P': /* Back the heap with huge pages, and count dTLB misses */
+            hugepages = 1;
+            perfcounters = 1;
+            break;
+        case 'X': /* Time restoring a heap snapshot against a rebuild */
+            snapshot = 1;
+            break;
+        case 'l': /* Print the libc malloc results */
+            show_libc = 1;
             break;
         case 'v': /* Print per-trace performance breakdown */
             verbose = 1;
@@ -194,48 +433,113 @@ int main(int argc, char **argv) {
      * If no -f command line arg, then use the entire set of tracefiles
      * defined in default_traces[]
      */
+    if (tracefiles == NULL && large) {
+        tracefiles = large_tracefiles;
+        num_tracefiles = sizeof(large_tracefiles) / sizeof(char *) - 1;
+        if (heap_limit == 0)
+            heap_limit = LARGE_MAX_HEAP;
+        printf("Using large tracefiles in %s\n", tracedir);
+    }
     if (tracefiles == NULL) {
         tracefiles = default_tracefiles;
         num_tracefiles = sizeof(default_tracefiles) / sizeof(char *) - 1;
         printf("Using default tracefiles in %s\n", tracedir);
     }
 
-    /* Initialize the timing package */
+    /* -A replays payload writes after the trace, when -Z has unmapped them */
+    if (split_touch && mmap_blocks) {
+        printf("Mapped blocks are gone before -A replays their writes, ignoring -A\n");
+        split_touch = 0;
+    }
+
+    /* -X saves the heap with mem_save, which has no room for mapped blocks */
+    if (snapshot && mmap_blocks) {
+        printf("Mapped blocks cannot be snapshotted, ignoring -X\n");
+        snapshot = 0;
+    }
+
+    /* The heap is reserved address space, so a large limit costs nothing */
+    if (heap_limit > 0)
+        mem_set_max_heap(heap_limit);
+    mem_set_hugepages(hugepages);
+
+    /* Initialize the timing package, then apply any overrides */
     init_fsecs();
+    if (kbest > 0)
+        set_fcyc_k(kbest);
+    if (epsilon >= 0)
+        set_fcyc_epsilon(epsilon);
+    if (samples > 0) {
+        set_fcyc_maxsamples(samples);
+        set_fsecs_runs(samples);
+    }
+    if (cold_cache >= 0)
+        set_fcyc_clear_cache(cold_cache);
+
+    /* Open the hardware performance counters, if asked to */
+    if (perfcounters && perfctr_init() == 0) {
+        printf("Hardware performance counters unavailable, ignoring -p\n");
+        perfcounters = 0;
+    }
 
     /*
-     * Optionally run and evaluate the libc malloc package
+     * Run and evaluate the libc malloc package. Its throughput on this
+     * host is what the mm throughput is measured against.
      */
-    if (run_libc) {
-        if (verbose > 1)
-            printf("\nTesting libc malloc\n");
+    if (verbose > 1)
+        printf("\nTesting libc malloc\n");
 
-        /* Allocate libc stats array, with one stats_t struct per tracefile */
-        libc_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
-        if (libc_stats == NULL)
-            unix_error("libc_stats calloc in main failed");
+    /* Allocate libc stats array, with one stats_t struct per tracefile */
+    libc_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
+    if (libc_stats == NULL)
+        unix_error("libc_stats calloc in main failed");
 
-        /* Evaluate the libc malloc package using the K-best scheme */
-        for (i = 0; i < num_tracefiles; i++) {
-            trace = read_trace(tracedir, tracefiles[i]);
-            libc_stats[i].ops = trace->num_ops;
+    /* Evaluate the libc malloc package using the K-best scheme */
+    for (i = 0; i < num_tracefiles; i++) {
+        trace = read_trace(tracedir, tracefiles[i]);
+        strncpy(libc_stats[i].trace_name, trace->trace_name, 1024);
+        libc_stats[i].ops = trace->num_ops;
+        libc_stats[i].weight = trace_weight(tracefiles[i], trace->weight);
+        if (verbose > 1)
+            printf("Checking libc malloc for correctness, ");
+        libc_stats[i].valid = eval_libc_valid(trace, i);
+        if (libc_stats[i].valid) {
+            speed_params.trace = trace;
+            speed_params.addrs = NULL;
+            speed_params.num_ops = 0;
             if (verbose > 1)
-                printf("Checking libc malloc for correctness, ");
-            libc_stats[i].valid = eval_libc_valid(trace, i);
-            if (libc_stats[i].valid) {
-                speed_params.trace = trace;
-                if (verbose > 1)
-                    printf("and performance.\n");
-                libc_stats[i].secs = fsecs(eval_libc_speed, &speed_params);
+                printf("and performance.\n");
+            libc_stats[i].secs = fsecs(eval_libc_speed, &speed_params);
+            libc_stats[i].secs_sd = fsecs_stddev();
+            libc_stats[i].samples = fsecs_samples();
+            if (perfcounters) {
+                perfctr_start();
+                eval_libc_speed(&speed_params);
+                perfctr_stop(libc_stats[i].counters);
             }
-            free_trace(trace);
         }
+        free_trace(trace);
+    }
 
-        /* Display the libc results in a compact table */
-        if (verbose) {
-            printf("\nResults for libc malloc:\n");
-            printresults(num_tracefiles, libc_stats);
+    /* The weighted libc throughput is the target unless -R set one */
+    weighted_totals(num_tracefiles, libc_stats, &avg_mm_util,
+                    &libc_throughput);
+    if (target <= 0) {
+        if (libc_throughput > 0) {
+            target = libc_throughput;
         }
+        else {
+            printf("libc failed every trace, using the reference throughput\n");
+            target = AVG_LIBC_THRUPUT;
+        }
+    }
+
+    /* Display the libc results in a compact table */
+    if (verbose && show_libc) {
+        printf("\nResults for libc malloc:\n");
+        printresults(num_tracefiles, libc_stats);
+        if (perfcounters)
+            printcounters(num_tracefiles, libc_stats);
     }
 
     /*
@@ -249,69 +553,109 @@ int main(int argc, char **argv) {
     if (mm_stats == NULL)
         unix_error("mm_stats calloc in main failed");
 
-    /* Initialize the simulated memory system in memlib.c */
-    mem_init();
-
     /* Evaluate student's mm malloc package using the K-best scheme */
-    for (i = 0; i < num_tracefiles; i++) {
-        trace = read_trace(tracedir, tracefiles[i]);
-        strncpy(mm_stats[i].trace_name, trace->trace_name, 1024);
-        mm_stats[i].ops = trace->num_ops;
-        if (verbose > 1)
-            printf("Checking mm_malloc for correctness, ");
-        mm_stats[i].valid = eval_mm_valid(trace, i, &ranges);
-        if (mm_stats[i].valid) {
-            if (verbose > 1)
-                printf("efficiency, ");
-            mm_stats[i].util = eval_mm_util(trace, i, &ranges);
-            speed_params.trace = trace;
-            speed_params.ranges = ranges;
-            if (verbose > 1)
-                printf("and performance.\n");
-            mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
-        }
-        free_trace(trace);
+    if (jobs > 0) {
+        eval_mm_parallel(num_tracefiles, tracefiles, mm_stats, jobs);
+    }
+    else {
+        /* Initialize the simulated memory system in memlib.c */
+        init_heap();
+        for (i = 0; i < num_tracefiles; i++)
+            eval_mm_trace(tracefiles[i], i, &mm_stats[i]);
     }
 
     /* Display the mm results in a compact table */
     if (verbose) {
         printf("\nResults for mm malloc:\n");
         printresults(num_tracefiles, mm_stats);
+        if (perfcounters)
+            printcounters(num_tracefiles, mm_stats);
+        if (split_touch)
+            printtouch(num_tracefiles, mm_stats);
+        if (hugepages)
+            printhuge(num_tracefiles, mm_stats);
+        if (release)
+            printresident(num_tracefiles, mm_stats);
+        if (prefault != NULL)
+            printfirst(num_tracefiles, mm_stats);
+        if (snapshot)
+            printsnapshot(num_tracefiles, mm_stats);
+        if (mmap_blocks) {
+            /* with -j only the workers have set up a heap */
+            if (jobs > 0)
+                init_heap();
+            eval_realloc_scaling(heap_limit ? heap_limit : MAX_HEAP);
+        }
         printf("\n");
     }
 
+    /*
+     * Evaluate each allocator loaded with -B on the same traces. Their
+     * failures show up in the comparison, not in mm's perf index.
+     */
+    if (backends != NULL) {
+        backend_stats = (stats_t **)calloc(num_backends, sizeof(stats_t *));
+        if (backend_stats == NULL)
+            unix_error("backend_stats calloc in main failed");
+        backend_stats[0] = mm_stats;
+        mm_errors = errors;
+        for (i = 1; i < num_backends; i++) {
+            be = backends[i];
+            if (verbose > 1)
+                printf("\nTesting %s\n", be->name);
+            backend_stats[i] = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
+            if (backend_stats[i] == NULL)
+                unix_error("backend_stats calloc in main failed");
+            if (jobs > 0)
+                eval_mm_parallel(num_tracefiles, tracefiles, backend_stats[i],
+                                 jobs);
+            else
+                for (j = 0; j < num_tracefiles; j++)
+                    eval_mm_trace(tracefiles[j], j, &backend_stats[i][j]);
+            if (verbose) {
+                printf("\nResults for %s:\n", be->name);
+                printresults(num_tracefiles, backend_stats[i]);
+                printf("\n");
+            }
+        }
+        be = &mm_backend;
+        errors = mm_errors;
+        printbackends(num_backends, backends, num_tracefiles, backend_stats);
+    }
+
     /*
      * Accumulate the aggregate statistics for the student's mm package
      */
-    secs = 0;
-    ops = 0;
-    util = 0;
     numcorrect = 0;
     for (i = 0; i < num_tracefiles; i++) {
-        secs += mm_stats[i].secs;
-        ops += mm_stats[i].ops;
-        util += mm_stats[i].util;
         if (mm_stats[i].valid)
             numcorrect++;
+        if (mm_stats[i].valid && libc_stats[i].valid && mm_stats[i].secs > 0)
+            mm_stats[i].libc_ratio = libc_stats[i].secs / mm_stats[i].secs;
     }
-    avg_mm_util = util / num_tracefiles;
+    weighted_totals(num_tracefiles, mm_stats, &avg_mm_util,
+                    &avg_mm_throughput);
+    if (verbose)
+        printratios(num_tracefiles, mm_stats, libc_stats);
 
     /*
      * Compute and print the performance index
      */
     if (errors == 0) {
-        avg_mm_throughput = ops / secs;
-
         p1 = UTIL_WEIGHT * avg_mm_util;
-        if (avg_mm_throughput > AVG_LIBC_THRUPUT) {
+        if (avg_mm_throughput > target) {
             p2 = (double)(1.0 - UTIL_WEIGHT);
         }
         else {
             p2 = ((double) (1.0 - UTIL_WEIGHT)) *
-                 (avg_mm_throughput / AVG_LIBC_THRUPUT);
+                 (avg_mm_throughput / target);
         }
 
         perfindex = (p1 + p2) * 100.0;
+        printf("Throughput = %.0f Kops, %.2fx libc (%.0f Kops), target %.0f Kops\n",
+               avg_mm_throughput / 1e3,
+               libc_throughput > 0 ? avg_mm_throughput / libc_throughput : 0.0,
+               libc_throughput / 1e3, target / 1e3);
         printf("Perf index = %.0f (util) + %.0f (thru) = %.0f/100\n",
                p1 * 100,
                p2 * 100,
@@ -328,7 +672,14 @@ int main(int argc, char **argv) {
         printf("perfidx:%.0f\n", perfindex);
     }
 
-    exit(0);
+    /* Optionally save the results and check them against a baseline */
+    if (outfile != NULL)
+        write_results(outfile, num_tracefiles, mm_stats);
+    if (baseline != NULL)
+        regressions = compare_baseline(baseline, num_tracefiles, mm_stats,
+                                       threshold);
+
+    exit(regressions ? 2 : 0);
 }
 
 
@@ -344,7 +695,7 @@ int main(int argc, char **argv) {
  *     size bytes at addr lo. After checking the block for correctness,
  *     we create a range struct for this block and add it to the range list.
  */
-static int add_range(range_t **ranges, char *lo, int size,
+static int add_range(range_t **ranges, char *lo, size_t size,
                      int tracenum, int opnum) {
     char *hi = lo + size - 1;
     range_t *p;
@@ -360,11 +711,10 @@ static int add_range(range_t **ranges, char *lo, int size,
         return 0;
     }
 
-    /* The payload must lie within the extent of the heap */
-    if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) ||
-            (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
-        sprintf(msg, "Payload (%p:%p) lies outside heap (%p:%p)",
-                lo, hi, mem_heap_lo(), mem_heap_hi());
+    /* The payload must lie within the extent of one heap segment */
+    if (!mem_in_heap(lo, size)) {
+        sprintf(msg, "Payload (%p:%p) lies outside the heap (%p:%p and any "
+                "earlier segments)", lo, hi, mem_heap_lo(), mem_heap_hi());
         malloc_error(tracenum, opnum, msg);
         return 0;
     }
@@ -425,130 +775,82 @@ static void clear_ranges(range_t **ranges) {
 }
 
 
-/**********************************************
- * The following routines manipulate tracefiles
- *********************************************/
+/**********************************************************************
+ * The following functions evaluate the correctness, space utilization,
+ * and throughput of the libc and mm malloc packages.
+ **********************************************************************/
 
 /*
- * read_trace - read a trace file and store it in memory
+ * be_init - Initialize the allocator under test for a trace, passing
+ *     the trace's suggested heap size as a hint if -H is set and the
+ *     page release threshold if -D is and the mmap threshold if -Z is.
+ *     A heap that cannot be presized starts empty instead. Returns 0,
+ *     or nonzero if the allocator could not be initialized at all.
  */
-static trace_t *read_trace(char *tracedir, char *filename) {
-    FILE *tracefile;
-    trace_t *trace;
-    char type[MAXLINE];
-    char path[MAXLINE];
-    unsigned index, size;
-    unsigned max_index = 0;
-    unsigned op_index;
-
-    if (verbose > 1)
-        printf("Reading tracefile: %s\n", filename);
-
-    /* Allocate the trace record */
-    if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
-        unix_error("malloc 1 failed in read_trance");
-
-    /* Read the trace file header */
-    strcpy(path, tracedir);
-    strcat(path, filename);
-    strncpy(trace->trace_name, filename, 1024);
-    if ((tracefile = fopen(path, "r")) == NULL) {
-        sprintf(msg, "Could not open %s in read_trace", path);
-        unix_error(msg);
-    }
-    fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
-    fscanf(tracefile, "%d", &(trace->num_ids));
-    fscanf(tracefile, "%d", &(trace->num_ops));
-    fscanf(tracefile, "%d", &(trace->weight));        /* not used */
-
-    /* We'll store each request line in the trace in this array */
-    if ((trace->ops =
-                (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
-        unix_error("malloc 2 failed in read_trace");
-
-    /* We'll keep an array of pointers to the allocated blocks here... */
-    if ((trace->blocks =
-                (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
-        unix_error("malloc 3 failed in read_trace");
-
-    /* ... along with the corresponding byte sizes of each block */
-    if ((trace->block_sizes =
-                (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
-        unix_error("malloc 4 failed in read_trace");
-
-    /* read every request line in the trace file */
-    index = 0;
-    op_index = 0;
-    while (fscanf(tracefile, "%s", type) != EOF) {
-        switch (type[0]) {
-        case 'a':
-            fscanf(tracefile, "%u %u", &index, &size);
-            trace->ops[op_index].type = ALLOC;
-            trace->ops[op_index].index = index;
-            trace->ops[op_index].size = size;
-            max_index = (index > max_index) ? index : max_index;
-            break;
-        case 'r':
-            fscanf(tracefile, "%u %u", &index, &size);
-            trace->ops[op_index].type = REALLOC;
-            trace->ops[op_index].index = index;
-            trace->ops[op_index].size = size;
-            max_index = (index > max_index) ? index : max_index;
-            break;
-        case 'f':
-            fscanf(tracefile, "%ud", &index);
-            trace->ops[op_index].type = FREE;
-            trace->ops[op_index].index = index;
-            break;
-        default:
-            printf("Bogus type character (%c) in tracefile %s\n",
-                   type[0], path);
-            exit(1);
+static int be_init(trace_t *trace) {
+    static trace_t *warned = NULL;
+
+    if (release && be->set_release != NULL)
+        be->set_release(release_threshold);
+    if (mmap_blocks && be->set_mmap != NULL)
+        be->set_mmap(mmap_threshold);
+    if (heap_hint && be->init_hint != NULL && trace->sugg_heapsize > 0) {
+        if (be->init_hint(trace->sugg_heapsize) == 0)
+            return 0;
+        if (warned != trace) {
+            fprintf(stderr, "WARNING: could not presize the heap to %zu "
+                    "bytes for %s, starting it empty\n",
+                    trace->sugg_heapsize, trace->trace_name);
+            warned = trace;
         }
-        op_index++;
-
+        be->reset();
     }
-    fclose(tracefile);
-    assert((int)max_index == trace->num_ids - 1);
-    assert((int)op_index == trace->num_ops);
-
-    return trace;
+    return be->init();
 }
 
 /*
- * free_trace - Free the trace record and the three arrays it points
- *              to, all of which were allocated in read_trace().
+ * init_heap - Set up memlib's simulated heap as chosen by -m: a malloc'd
+ *     buffer, a mapping committed as it is touched, a reservation
+ *     committed and decommitted as the brk moves, or a shared mapping of
+ *     a temporary file that grows and shrinks with the brk
  */
-void free_trace(trace_t *trace) {
-    free(trace->ops);         /* free the three arrays... */
-    free(trace->blocks);
-    free(trace->block_sizes);
-    free(trace);              /* and the trace record itself... */
+static void init_heap(void) {
+    char path[] = "/tmp/mdriver.heap.XXXXXX";
+    int fd;
+
+    if (!strcmp(heap_mode, "malloc"))
+        mem_init();
+    else if (!strcmp(heap_mode, "reserve"))
+        mem_init_reserve();
+    else if (!strcmp(heap_mode, "file")) {
+        /* the mapping keeps the file for as long as we need it */
+        if ((fd = mkstemp(path)) < 0 || mem_init_file(path) < 0)
+            unix_error("Could not create a heap file in /tmp");
+        close(fd);
+        unlink(path);
+    }
+    else
+        mem_init_vm();
 }
 
-/**********************************************************************
- * The following functions evaluate the correctness, space utilization,
- * and throughput of the libc and mm malloc packages.
- **********************************************************************/
-
 /*
  * eval_mm_valid - Check the mm malloc package for correctness
  */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) {
-    int i, j;
+    int i;
     int index;
-    int size;
-    int oldsize;
+    size_t j, size;
+    size_t oldsize;
     char *newp;
     char *oldp;
     char *p;
 
     /* Reset the heap and free any records in the range list */
-    mem_reset_brk();
+    be->reset();
     clear_ranges(ranges);
 
     /* Call the mm package's init function */
-    if (mm_init() < 0) {
+    if (be_init(trace) != 0) {
         malloc_error(tracenum, 0, "mm_init failed.");
         return 0;
     }
@@ -563,7 +865,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) {
         case ALLOC: /* mm_malloc */
 
             /* Call the student's malloc */
-            if ((p = mm_malloc(size)) == NULL) {
+            if ((p = be->malloc(size)) == NULL) {
                 malloc_error(tracenum, i, "mm_malloc failed.");
                 return 0;
             }
@@ -592,7 +894,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) {
 
             /* Call the student's realloc */
             oldp = trace->blocks[index];
-            if ((newp = mm_realloc(oldp, size)) == NULL) {
+            if ((newp = be->realloc(oldp, size)) == NULL) {
                 malloc_error(tracenum, i, "mm_realloc failed.");
                 return 0;
             }
@@ -612,7 +914,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) {
             oldsize = trace->block_sizes[index];
             if (size < oldsize) oldsize = size;
             for (j = 0; j < oldsize; j++) {
-                if (newp[j] != (index & 0xFF)) {
+                if ((unsigned char)newp[j] != (index & 0xFF)) {
                     malloc_error(tracenum, i, "mm_realloc did not preserve the "
                                  "data from old block");
                     return 0;
@@ -630,7 +932,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) {
             /* Remove region from list and call student's free function */
             p = trace->blocks[index];
             remove_range(ranges, p);
-            mm_free(p);
+            be->free(p);
             break;
 
         default:
@@ -648,10 +950,9 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) {
  *   The idea is to remember the high water mark "hwm" of the heap for
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the
- *   size of the heap in bytes after running the student's malloc
- *   package on the trace. Note that our implementation of mem_sbrk()
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap.
+ *   largest size of the heap in bytes while running the student's
+ *   malloc package on the trace. The package may shrink the heap with
+ *   a negative mem_sbrk(), so memlib records that high water mark.
  *
  */
 static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges) {
@@ -660,19 +961,25 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges) {
 
     int i;
     int index;
-    int size, newsize, oldsize;
-    int max_total_size = 0;
-    int total_size = 0;
+    size_t size, newsize, oldsize;
+    size_t max_total_size = 0;
+    size_t total_size = 0;
     char *p;
     char *newp, *oldp;
+    FILE *timeline_fp = NULL;
 
     /* initialize the heap and the mm malloc package */
-    mem_reset_brk();
+    be->reset();
     clear_ranges(ranges);
-    if (mm_init() < 0)
+    if (be_init(trace) != 0)
         app_error("mm_init failed in eval_mm_util");
+    if (timeline > 0)
+        timeline_fp = timeline_open(trace);
 
     for (i = 0;  i < trace->num_ops;  i++) {
+        if (timeline_fp != NULL && i % timeline == 0)
+            timeline_sample(timeline_fp, i, total_size);
+
         index = trace->ops[i].index;
         size = trace->ops[i].size;
 
@@ -682,7 +989,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges) {
             index = trace->ops[i].index;
             size = trace->ops[i].size;
 
-            if ((p = mm_malloc(size)) == NULL)
+            if ((p = be->malloc(size)) == NULL)
                 app_error("mm_malloc failed in eval_mm_util");
 
             /* Still need to memset, because otherwise there's no guarantee the space is usable */
@@ -709,7 +1016,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges) {
             oldsize = trace->block_sizes[index];
 
             oldp = trace->blocks[index];
-            if ((newp = mm_realloc(oldp, newsize)) == NULL)
+            if ((newp = be->realloc(oldp, newsize)) == NULL)
                 app_error("mm_realloc failed in eval_mm_util");
 
             /* Still need to memset and check region integrity */
@@ -740,7 +1047,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges) {
             p = trace->blocks[index];
             remove_range(ranges, p);
 
-            mm_free(p);
+            be->free(p);
 
             /* Keep track of current total size
              * of all allocated blocks */
@@ -754,7 +1061,12 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges) {
         }
     }
 
-    return ((double)max_total_size / (double)mem_heapsize());
+    if (timeline_fp != NULL) {
+        timeline_sample(timeline_fp, trace->num_ops, total_size);
+        fclose(timeline_fp);
+    }
+
+    return ((double)max_total_size / (double)mem_peak_heapsize());
 }
 
 
@@ -763,17 +1075,23 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges) {
  *    to measure the running time of the mm malloc package.
  */
 static void eval_mm_speed(void *ptr) {
-    int i, index, size, newsize;
+    int i, index;
+    size_t size, newsize;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
+    char **addrs = ((speed_t *)ptr)->addrs;
+    int num_ops = ((speed_t *)ptr)->num_ops;
+
+    if (num_ops == 0)
+        num_ops = trace->num_ops;
 
     /* Reset the heap and initialize the mm package */
-    mem_reset_brk();
-    if (mm_init() < 0)
+    be->reset();
+    if (be_init(trace) != 0)
         app_error("mm_init failed in eval_mm_speed");
 
     /* Interpret each trace request */
-    for (i = 0;  i < trace->num_ops;  i++) {
+    for (i = 0;  i < num_ops;  i++) {
         index = trace->ops[i].index;
         size = trace->ops[i].size;
         switch (trace->ops[i].type) {
@@ -781,26 +1099,30 @@ static void eval_mm_speed(void *ptr) {
         case ALLOC: /* mm_malloc */
             index = trace->ops[i].index;
             size = trace->ops[i].size;
-            if ((p = mm_malloc(size)) == NULL)
+            if ((p = be->malloc(size)) == NULL)
                 app_error("mm_malloc error in eval_mm_speed");
             memset(p, index & 0xFF, size);
             trace->blocks[index] = p;
+            if (addrs != NULL)
+                addrs[i] = p;
             break;
 
         case REALLOC: /* mm_realloc */
             index = trace->ops[i].index;
             newsize = trace->ops[i].size;
             oldp = trace->blocks[index];
-            if ((newp = mm_realloc(oldp, newsize)) == NULL)
+            if ((newp = be->realloc(oldp, newsize)) == NULL)
                 app_error("mm_realloc error in eval_mm_speed");
             memset(newp, index & 0xFF, size);
             trace->blocks[index] = newp;
+            if (addrs != NULL)
+                addrs[i] = newp;
             break;
 
         case FREE: /* mm_free */
             index = trace->ops[i].index;
             block = trace->blocks[index];
-            mm_free(block);
+            be->free(block);
             break;
 
         default:
@@ -809,6 +1131,556 @@ static void eval_mm_speed(void *ptr) {
     }
 }
 
+/*
+ * eval_mm_once - Run the trace through mm once, outside the timing
+ *     package, returning its wall-clock time and storing the page
+ *     faults it took in *faults
+ */
+static double eval_mm_once(speed_t *params, double *faults) {
+    struct timespec t0, t1;
+    struct rusage r0, r1;
+
+    getrusage(RUSAGE_SELF, &r0);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &t0);
+    eval_mm_speed(params);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &t1);
+    getrusage(RUSAGE_SELF, &r1);
+    *faults = (r1.ru_minflt - r0.ru_minflt) + (r1.ru_majflt - r0.ru_majflt);
+    return (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+}
+
+/*
+ * eval_touch_speed - Replay only the payload writes that eval_mm_speed
+ *    makes, at the addresses it recorded in addrs, without calling the
+ *    mm package. Subtracting this from the eval_mm_speed time leaves
+ *    the time spent inside the allocator itself.
+ */
+static void eval_touch_speed(void *ptr) {
+    int i;
+    trace_t *trace = ((speed_t *)ptr)->trace;
+    char **addrs = ((speed_t *)ptr)->addrs;
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+        if (trace->ops[i].type != FREE)
+            memset(addrs[i], trace->ops[i].index & 0xFF, trace->ops[i].size);
+    }
+}
+
+/*
+ * eval_mm_latency - Time each request of the trace on its own and record
+ *    the median and 99th percentile latency. The cost of reading the
+ *    clock, calibrated first, is taken off every sample.
+ */
+static void eval_mm_latency(trace_t *trace, stats_t *stats) {
+    struct timespec t0, t1;
+    double *ns, overhead = DBL_MAX, d;
+    int i, index, n = trace->num_ops;
+    size_t size;
+    char *p = NULL;
+
+    if (n == 0)
+        return;
+    if ((ns = (double *)malloc(n * sizeof(double))) == NULL)
+        unix_error("malloc failed in eval_mm_latency");
+
+    for (i = 0; i < 1000; i++) {
+        clock_gettime(CLOCK_MONOTONIC_RAW, &t0);
+        clock_gettime(CLOCK_MONOTONIC_RAW, &t1);
+        d = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+        if (d < overhead)
+            overhead = d;
+    }
+
+    be->reset();
+    if (be_init(trace) != 0)
+        app_error("mm_init failed in eval_mm_latency");
+
+    for (i = 0;  i < n;  i++) {
+        index = trace->ops[i].index;
+        size = trace->ops[i].size;
+
+        clock_gettime(CLOCK_MONOTONIC_RAW, &t0);
+        switch (trace->ops[i].type) {
+        case ALLOC:
+            p = be->malloc(size);
+            break;
+        case REALLOC:
+            p = be->realloc(trace->blocks[index], size);
+            break;
+        case FREE:
+            be->free(trace->blocks[index]);
+            break;
+        default:
+            app_error("Nonexistent request type in eval_mm_latency");
+        }
+        clock_gettime(CLOCK_MONOTONIC_RAW, &t1);
+
+        if (trace->ops[i].type != FREE) {
+            if (p == NULL)
+                app_error("mm_malloc error in eval_mm_latency");
+            memset(p, index & 0xFF, size);
+            trace->blocks[index] = p;
+        }
+        d = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+        ns[i] = (d > overhead) ? d - overhead : 0;
+    }
+
+    qsort(ns, n, sizeof(double), double_cmp);
+    stats->p50_ns = ns[n / 2];
+    stats->p99_ns = ns[(int)(0.99 * (n - 1))];
+    free(ns);
+}
+
+/*
+ * eval_mm_snapshot - Compare two ways of getting mm's heap back to the
+ *    state it is in at the trace's peak of live bytes: replaying the
+ *    trace up to there from an empty heap, and mm_restore of a snapshot
+ *    taken there with mm_snapshot. Both are timed with fsecs. A mapped
+ *    heap restores lazily, so its time leaves out the page faults that
+ *    bring the snapshot in; those are paid by the requests that follow.
+ *    The rest of the trace is then run on the restored heap, checking
+ *    that the blocks live at the peak kept their contents.
+ */
+static void eval_mm_snapshot(trace_t *trace, int tracenum, stats_t *stats) {
+    speed_t speed_params;
+    char path[] = "/tmp/mdriver.snapshot.XXXXXX";
+    struct stat st;
+    size_t live = 0, peak = 0, size, j;
+    int *is_live;
+    int i, index, fd;
+    char *p;
+
+    /* Find the op that leaves the most payload bytes allocated */
+    if ((is_live = (int *)calloc(trace->num_ids, sizeof(int))) == NULL)
+        unix_error("calloc failed in eval_mm_snapshot");
+    stats->peak_op = 0;
+    for (i = 0; i < trace->num_ops; i++) {
+        index = trace->ops[i].index;
+        if (trace->ops[i].type != ALLOC)
+            live -= trace->block_sizes[index];
+        if (trace->ops[i].type != FREE)
+            live += trace->block_sizes[index] = trace->ops[i].size;
+        if (live > peak) {
+            peak = live;
+            stats->peak_op = i + 1;
+        }
+    }
+
+    /* The last timed rebuild leaves the heap at the peak */
+    speed_params.trace = trace;
+    speed_params.ranges = NULL;
+    speed_params.addrs = NULL;
+    speed_params.num_ops = stats->peak_op;
+    stats->rebuild_secs = fsecs(eval_mm_speed, &speed_params);
+
+    /* Fill each block live at the peak with its id, all of its bytes */
+    for (i = 0; i < stats->peak_op; i++) {
+        index = trace->ops[i].index;
+        is_live[index] = (trace->ops[i].type != FREE);
+        if (is_live[index])
+            trace->block_sizes[index] = trace->ops[i].size;
+    }
+    for (i = 0; i < trace->num_ids; i++)
+        if (is_live[i])
+            memset(trace->blocks[i], i & 0xFF, trace->block_sizes[i]);
+
+    if ((fd = mkstemp(path)) < 0)
+        unix_error("mkstemp failed in eval_mm_snapshot");
+    close(fd);
+    if (mm_snapshot(path) < 0 || stat(path, &st) < 0)
+        unix_error("mm_snapshot failed in eval_mm_snapshot");
+    stats->snapshot_bytes = st.st_size;
+    stats->restore_secs = fsecs(eval_restore_speed, path);
+    unlink(path);
+
+    /* Carry on from the peak with the blocks where the restore put them */
+    for (i = 0; i < trace->num_ids; i++)
+        if (is_live[i])
+            trace->blocks[i] = mem_relocate(trace->blocks[i]);
+    for (i = stats->peak_op; i < trace->num_ops; i++) {
+        index = trace->ops[i].index;
+        size = trace->ops[i].size;
+        p = trace->blocks[index];
+        if (trace->ops[i].type != ALLOC && is_live[index]) {
+            is_live[index] = 0;
+            for (j = 0; j < trace->block_sizes[index]; j++)
+                if ((unsigned char)p[j] != (index & 0xFF))
+                    break;
+            if (j < trace->block_sizes[index]) {
+                malloc_error(tracenum, i, "block changed by mm_restore");
+                break;
+            }
+        }
+        if (trace->ops[i].type == FREE) {
+            mm_free(p);
+            continue;
+        }
+        p = (trace->ops[i].type == ALLOC) ? mm_malloc(size) :
+            mm_realloc(p, size);
+        if (p == NULL) {
+            malloc_error(tracenum, i, "mm_malloc failed after mm_restore");
+            break;
+        }
+        memset(p, index & 0xFF, size);
+        trace->blocks[index] = p;
+        trace->block_sizes[index] = size;
+    }
+    free(is_live);
+
+    /* Give the heap ordinary pages again, and the snapshot its disk space */
+    mem_reset_brk();
+}
+
+/*
+ * eval_restore_speed - Restore the heap from the snapshot file named by
+ *    ptr, the function that fsecs times for eval_mm_snapshot
+ */
+static void eval_restore_speed(void *ptr) {
+    if (mm_restore((char *)ptr) < 0)
+        app_error("mm_restore failed in eval_restore_speed");
+}
+
+/*
+ * eval_realloc_scaling - Time a realloc that doubles one block, from
+ *    1 MB up to 1 GB or as far as the heap limit allows, first with the
+ *    block in the heap and then with blocks of at least the -Z threshold
+ *    mapped. The heap realloc copies the payload, so its time grows with
+ *    the size; the mapped one moves the pages with mremap. Each step is
+ *    the best of SCALING_RUNS, and the new half of the block is written
+ *    after it so the next step has real pages to copy or move.
+ */
+static void eval_realloc_scaling(size_t max_heap) {
+    double ns[2][SCALING_STEPS], d;
+    struct timespec t0, t1;
+    size_t size, top = SCALING_MIN;
+    int mapped, run, i, steps = 0;
+    char *p;
+
+    /* a heap realloc to top needs the old block and the new one */
+    while (steps < SCALING_STEPS && 4 * (2 * top) <= max_heap) {
+        top *= 2;
+        steps++;
+    }
+    if (steps == 0) {
+        printf("\nHeap limit too small to time realloc scaling (see -S)\n");
+        return;
+    }
+
+    for (mapped = 0; mapped < 2; mapped++) {
+        for (i = 0; i < steps; i++)
+            ns[mapped][i] = DBL_MAX;
+        for (run = 0; run < SCALING_RUNS; run++) {
+            mem_reset_brk();
+            mm_set_mmap_threshold(mapped ? mmap_threshold : 0);
+            if (mm_init() != 0)
+                app_error("mm_init failed in eval_realloc_scaling");
+            if ((p = mm_malloc(SCALING_MIN)) == NULL)
+                app_error("mm_malloc failed in eval_realloc_scaling");
+            memset(p, 1, SCALING_MIN);
+            for (i = 0, size = SCALING_MIN; i < steps; i++, size *= 2) {
+                clock_gettime(CLOCK_MONOTONIC_RAW, &t0);
+                p = mm_realloc(p, 2 * size);
+                clock_gettime(CLOCK_MONOTONIC_RAW, &t1);
+                if (p == NULL)
+                    app_error("mm_realloc failed in eval_realloc_scaling");
+                memset(p + size, 1, size);
+                d = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+                if (d < ns[mapped][i])
+                    ns[mapped][i] = d;
+            }
+            mm_free(p);
+        }
+    }
+    mem_reset_brk();
+
+    printf("\n%10s%14s%14s%9s\n", "size MB", "heap usecs", "mapped usecs",
+           "speedup");
+    printf("-----------------------------------------------\n");
+    for (i = 0, size = 2 * SCALING_MIN; i < steps; i++, size *= 2)
+        printf("%10zu%14.1f%14.1f%9.1f\n", size >> 20,
+               ns[0][i] / 1e3, ns[1][i] / 1e3,
+               ns[1][i] > 0 ? ns[0][i] / ns[1][i] : 0.0);
+}
+
+/*
+ * timeline_open - Create the timeline CSV for a trace in the current
+ *    directory, named after the trace file, and write its header row.
+ */
+static FILE *timeline_open(trace_t *trace) {
+    FILE *fp;
+    char path[MAXLINE + 16];
+    char *name = strrchr(trace->trace_name, '/');
+
+    name = (name == NULL) ? trace->trace_name : name + 1;
+    sprintf(path, "%s.timeline.csv", name);
+    if ((fp = fopen(path, "w")) == NULL) {
+        sprintf(msg, "Could not open %.900s.timeline.csv", name);
+        unix_error(msg);
+    }
+    if (verbose > 1)
+        printf("Writing timeline: %s\n", path);
+    fprintf(fp, "op,live_bytes,heap_size,free_blocks,largest_free,util,resident\n");
+    return fp;
+}
+
+/*
+ * timeline_sample - Record the live payload bytes, heap size, and free
+ *    block statistics after the first opnum requests of the trace.
+ */
+static void timeline_sample(FILE *fp, int opnum, size_t live_bytes) {
+    size_t heapsize = mem_heapsize();
+    size_t free_blocks, largest_free;
+
+    if (be->free_stats != NULL)
+        be->free_stats(&free_blocks, &largest_free);
+    else
+        free_blocks = largest_free = 0;
+    fprintf(fp, "%d,%zu,%zu,%zu,%zu,%.6f,%zu\n", opnum, live_bytes, heapsize,
+            free_blocks, largest_free,
+            heapsize ? (double)live_bytes / (double)heapsize : 0.0,
+            mem_resident_bytes());
+}
+
+/*
+ * eval_mm_trace - Read one trace file and check the mm package on it
+ *    for correctness, utilization, and speed, filling in its stats.
+ *    The simulated memory system must already be initialized.
+ */
+static void eval_mm_trace(char *tracefile, int tracenum, stats_t *stats) {
+    trace_t *trace;
+    range_t *ranges = NULL;
+    speed_t speed_params;
+
+    trace = read_trace(tracedir, tracefile);
+    strncpy(stats->trace_name, trace->trace_name, 1024);
+    stats->ops = trace->num_ops;
+    stats->weight = trace_weight(tracefile, trace->weight);
+    if (verbose > 1)
+        printf("Checking mm_malloc for correctness, ");
+    stats->valid = eval_mm_valid(trace, tracenum, &ranges);
+    if (stats->valid) {
+        if (verbose > 1)
+            printf("efficiency, ");
+        stats->util = eval_mm_util(trace, tracenum, &ranges);
+        speed_params.trace = trace;
+        speed_params.ranges = ranges;
+        speed_params.addrs = NULL;
+        speed_params.num_ops = 0;
+        if (verbose > 1)
+            printf("and performance.\n");
+        if (prefault != NULL) {
+            /* The validity run left the heap at its peak size */
+            if (strcmp(prefault, "none") &&
+                    mem_prefault(mem_peak_heapsize(),
+                                 !strcmp(prefault, "lock")) < 0)
+                printf("Could not prefault %s the heap for %s\n", prefault,
+                       trace->trace_name);
+            stats->first_secs = eval_mm_once(&speed_params,
+                                             &stats->first_faults);
+        }
+        stats->secs = fsecs(eval_mm_speed, &speed_params);
+        stats->secs_sd = fsecs_stddev();
+        stats->samples = fsecs_samples();
+        if (prefault != NULL)
+            eval_mm_once(&speed_params, &stats->steady_faults);
+        if (perfcounters) {
+            perfctr_start();
+            eval_mm_speed(&speed_params);
+            perfctr_stop(stats->counters);
+        }
+        stats->heap_bytes = mem_peak_heapsize();
+        if (hugepages)
+            stats->huge_bytes = mem_hugepage_bytes();
+        if (release)
+            stats->resident_bytes = mem_resident_bytes();
+        if (latency)
+            eval_mm_latency(trace, stats);
+        if (split_touch) {
+            /* Record where each payload lands, then time just the writes */
+            if ((speed_params.addrs =
+                        (char **)calloc(trace->num_ops, sizeof(char *))) == NULL)
+                unix_error("calloc failed in eval_mm_trace");
+            eval_mm_speed(&speed_params);
+            stats->touch_secs = fsecs(eval_touch_speed, &speed_params);
+            free(speed_params.addrs);
+        }
+        if (snapshot && be == &mm_backend)
+            eval_mm_snapshot(trace, tracenum, stats);
+    }
+    clear_ranges(&ranges);
+    free_trace(trace);
+}
+
+/*
+ * eval_mm_parallel - Evaluate the mm package on every trace using up
+ *    to jobs worker processes at once. Each worker is pinned to its
+ *    own core, builds its own simulated heap with init_heap, and sends
+ *    its stats and error count back to us through a pipe. Workers
+ *    never share a core, so jobs is capped at the number of cores
+ *    pick_cores finds, to keep the timings comparable with a
+ *    sequential run.
+ */
+static void eval_mm_parallel(int n, char **tracefiles, stats_t *stats,
+                             int jobs) {
+    /* What a worker sends back to the parent */
+    typedef struct {
+        stats_t stats;
+        int errors;
+    } result_t;
+
+    int *cores;       /* the CPU each slot's worker is pinned to */
+    int ncores;
+    pid_t *pids;      /* worker running in each slot, or 0 if idle */
+    int *slot_trace;  /* trace evaluated by the worker in each slot */
+    int *slot_fd;     /* read end of the worker's result pipe */
+    int next = 0, running = 0;
+    int fds[2], slot, status;
+    pid_t pid;
+    cpu_set_t cpus;
+    result_t result;
+
+    if ((cores = (int *)calloc(CPU_SETSIZE, sizeof(int))) == NULL)
+        unix_error("calloc failed in eval_mm_parallel");
+    ncores = pick_cores(cores, CPU_SETSIZE);
+    if (jobs > ncores) {
+        printf("Only %d cores available, running %d workers instead of %d\n",
+               ncores, ncores, jobs);
+        jobs = ncores;
+    }
+
+    pids = (pid_t *)calloc(jobs, sizeof(pid_t));
+    slot_trace = (int *)calloc(jobs, sizeof(int));
+    slot_fd = (int *)calloc(jobs, sizeof(int));
+    if (pids == NULL || slot_trace == NULL || slot_fd == NULL)
+        unix_error("calloc failed in eval_mm_parallel");
+
+    while (next < n || running > 0) {
+        /* Start a worker in every idle slot while traces remain */
+        for (slot = 0; slot < jobs && next < n; slot++) {
+            if (pids[slot] != 0)
+                continue;
+            if (pipe(fds) < 0)
+                unix_error("pipe failed in eval_mm_parallel");
+            fflush(stdout);  /* don't let the worker repeat our output */
+            if ((pid = fork()) < 0)
+                unix_error("fork failed in eval_mm_parallel");
+
+            if (pid == 0) {
+                /* Worker: pin to our core, then run the trace */
+                close(fds[0]);
+                CPU_ZERO(&cpus);
+                CPU_SET(cores[slot], &cpus);
+                if (sched_setaffinity(0, sizeof(cpus), &cpus) < 0)
+                    printf("WARNING: could not pin worker to CPU %d, its "
+                           "timings may be off\n", cores[slot]);
+
+                /* Counters opened by the parent only count the parent */
+                if (perfcounters) {
+                    perfctr_deinit();
+                    perfctr_init();
+                }
+
+                init_heap();
+                memset(&result, 0, sizeof(result));
+                eval_mm_trace(tracefiles[next], next, &result.stats);
+                result.errors = errors;
+                if (write(fds[1], &result, sizeof(result)) != sizeof(result))
+                    unix_error("write failed in eval_mm_parallel");
+                fflush(stdout);
+                _exit(0);
+            }
+
+            close(fds[1]);
+            pids[slot] = pid;
+            slot_trace[slot] = next;
+            slot_fd[slot] = fds[0];
+            running++;
+            next++;
+        }
+
+        /* Wait for any worker to finish and collect its stats */
+        if ((pid = wait(&status)) < 0)
+            unix_error("wait failed in eval_mm_parallel");
+        for (slot = 0; slot < jobs; slot++)
+            if (pids[slot] == pid)
+                break;
+        if (slot == jobs)
+            continue;
+
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0 &&
+                read(slot_fd[slot], &result, sizeof(result)) == sizeof(result)) {
+            stats[slot_trace[slot]] = result.stats;
+            errors += result.errors;
+        }
+        else {
+            strncpy(stats[slot_trace[slot]].trace_name,
+                    tracefiles[slot_trace[slot]], 1023);
+            stats[slot_trace[slot]].weight =
+                trace_weight(tracefiles[slot_trace[slot]], 1);
+            stats[slot_trace[slot]].valid = 0;
+            printf("ERROR [trace %d]: worker did not finish\n",
+                   slot_trace[slot]);
+            errors++;
+        }
+        close(slot_fd[slot]);
+        pids[slot] = 0;
+        running--;
+    }
+
+    free(cores);
+    free(pids);
+    free(slot_trace);
+    free(slot_fd);
+}
+
+/*
+ * pick_cores - Choose the CPUs the -j workers are pinned to: those in
+ *    our affinity mask, taking one hardware thread per physical core so
+ *    that no two workers share a core through SMT. A CPU whose siblings
+ *    cannot be read from sysfs counts as a core of its own. Returns how
+ *    many were stored in cores, at least 1.
+ */
+static int pick_cores(int *cores, int max) {
+    cpu_set_t allowed, taken;
+    char path[128], list[256];
+    FILE *fp;
+    int cpu, first, last, n = 0;
+    char *s;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) {
+        printf("WARNING: could not read the CPU affinity mask, using CPU 0\n");
+        cores[0] = 0;
+        return 1;
+    }
+    CPU_ZERO(&taken);
+    for (cpu = 0; cpu < CPU_SETSIZE && n < max; cpu++) {
+        if (!CPU_ISSET(cpu, &allowed) || CPU_ISSET(cpu, &taken))
+            continue;
+        cores[n++] = cpu;
+
+        /* Its SMT siblings, as a list like "0,64" or "0-1" */
+        sprintf(path, "/sys/devices/system/cpu/cpu%d/topology/"
+                "thread_siblings_list", cpu);
+        if ((fp = fopen(path, "r")) == NULL)
+            continue;
+        if (fgets(list, sizeof(list), fp) != NULL) {
+            for (s = list; *s >= '0' && *s <= '9'; ) {
+                first = last = strtol(s, &s, 10);
+                if (*s == '-')
+                    last = strtol(s + 1, &s, 10);
+                for (; first <= last && first < CPU_SETSIZE; first++)
+                    CPU_SET(first, &taken);
+                if (*s == ',')
+                    s++;
+            }
+        }
+        fclose(fp);
+    }
+    if (n == 0)
+        cores[n++] = 0;
+    return n;
+}
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -816,7 +1688,8 @@ static void eval_mm_speed(void *ptr) {
  *
  */
 static int eval_libc_valid(trace_t *trace, int tracenum) {
-    int i, newsize;
+    int i;
+    size_t newsize;
     char *p, *newp, *oldp;
 
     for (i = 0;  i < trace->num_ops;  i++) {
@@ -855,11 +1728,13 @@ static int eval_libc_valid(trace_t *trace, int tracenum) {
 /*
  * eval_libc_speed - This is the function that is used by fcyc() to
  *    measure the running time of the libc malloc package on the set
- *    of traces.
+ *    of traces. It writes every payload just as eval_mm_speed does, so
+ *    the two times are comparable.
  */
 static void eval_libc_speed(void *ptr) {
     int i;
-    int index, size, newsize;
+    int index;
+    size_t size, newsize;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
 
@@ -870,6 +1745,7 @@ static void eval_libc_speed(void *ptr) {
             size = trace->ops[i].size;
             if ((p = malloc(size)) == NULL)
                 unix_error("malloc failed in eval_libc_speed");
+            memset(p, index & 0xFF, size);
             trace->blocks[index] = p;
             break;
 
@@ -879,7 +1755,7 @@ static void eval_libc_speed(void *ptr) {
             oldp = trace->blocks[index];
             if ((newp = realloc(oldp, newsize)) == NULL)
                 unix_error("realloc failed in eval_libc_speed\n");
-
+            memset(newp, index & 0xFF, newsize);
             trace->blocks[index] = newp;
             break;
 
@@ -905,24 +1781,29 @@ static void printresults(int n, stats_t *stats) {
     double secs = 0;
     double ops = 0;
     double util = 0;
+    double var = 0;
 
     /* Print the individual results for each trace */
-    printf("%6s %4s                %12s %5s%5s%8s%11s\n",
-           "trace#", " name", " consistent", "util", "ops", "secs", "Kops");
-    printf("-----------------------------------------------------------------------\n");
+    printf("%6s %4s                %12s %5s%5s%8s%11s%8s\n",
+           "trace#", " name", " consistent", "util", "ops", "secs", "Kops",
+           "+/-95%");
+    printf("-------------------------------------------------------------------------------\n");
     for (i = 0; i < n; i++) {
         if (stats[i].valid) {
-            printf(" %-2d     %-19s   %-9s%5.0f%%%8.0f%10.6f%8.0f\n",
+            printf(" %-2d     %-19s   %-9s%5.0f%%%8.0f%10.6f%8.0f%7.1f%%\n",
                    i,
                    stats[i].trace_name,
                    "yes",
                    stats[i].util * 100.0,
                    stats[i].ops,
                    stats[i].secs,
-                   (stats[i].ops / 1e3) / stats[i].secs);
+                   (stats[i].ops / 1e3) / stats[i].secs,
+                   100.0 * ci95(stats[i].secs_sd, stats[i].samples) /
+                   stats[i].secs);
             secs += stats[i].secs;
             ops += stats[i].ops;
             util += stats[i].util;
+            var += stats[i].secs_sd * stats[i].secs_sd / stats[i].samples;
         }
         else {
             printf(" %-2d     %-19s   %-7s%6s%6s%7s%11s\n",
@@ -938,12 +1819,23 @@ static void printresults(int n, stats_t *stats) {
 
     /* Print the aggregate results for the set of traces */
     if (errors == 0) {
-        printf("%24s%10.0f%%%8.0f%10.6f%8.0f\n",
+        printf("%24s%10.0f%%%8.0f%10.6f%8.0f%7.1f%%\n",
                "Total                             ",
                (util / n) * 100.0,
                ops,
                secs,
-               (ops / 1e3) / secs);
+               (ops / 1e3) / secs,
+               100.0 * 1.96 * sqrt(var) / secs);
+
+        /* The composite scores, when the traces are not equally weighted */
+        for (i = 1; i < n; i++)
+            if (stats[i].weight != stats[0].weight)
+                break;
+        if (i < n) {
+            weighted_totals(n, stats, &util, &secs);
+            printf("%-34s%10.0f%%%26.0f\n", "Weighted", util * 100.0,
+                   secs / 1e3);
+        }
     }
     else {
         printf("%12s%30s%6s%7s%11s\n",
@@ -956,6 +1848,579 @@ static void printresults(int n, stats_t *stats) {
 
 }
 
+/*
+ * ci95 - Half-width of the 95% confidence interval for the mean of
+ *     samples measurements with standard deviation sd
+ */
+static double ci95(double sd, int samples) {
+    if (samples < 2)
+        return 0;
+    return 1.96 * sd / sqrt(samples);
+}
+
+/*
+ * printcounters - prints the hardware events per op for each trace,
+ *     along with the events for the whole trace in the Total row
+ */
+static void printcounters(int n, stats_t *stats) {
+    int i, j;
+    double ops = 0;
+    double totals[PERFCTR_NUM] = {0};
+
+    printf("\n%6s %-19s", "trace#", " events/op");
+    for (j = 0; j < PERFCTR_NUM; j++)
+        printf("%10s", perfctr_names[j]);
+    printf("\n");
+    printf("-----------------------------------------------------------------------------------\n");
+    for (i = 0; i < n; i++) {
+        if (!stats[i].valid)
+            continue;
+        printf(" %-2d     %-19s", i, stats[i].trace_name);
+        for (j = 0; j < PERFCTR_NUM; j++) {
+            if (stats[i].counters[j] < 0) {
+                printf("%10s", "-");
+                totals[j] = -1;
+            }
+            else {
+                printf("%10.2f", stats[i].counters[j] / stats[i].ops);
+                if (totals[j] >= 0)
+                    totals[j] += stats[i].counters[j];
+            }
+        }
+        printf("\n");
+        ops += stats[i].ops;
+    }
+
+    /* Totals are in events for the whole suite, not per op */
+    printf("%-26s", "Total (events)");
+    for (j = 0; j < PERFCTR_NUM; j++) {
+        if (totals[j] < 0 || ops == 0)
+            printf("%10s", "-");
+        else
+            printf("%10.4g", totals[j]);
+    }
+    printf("\n");
+}
+
+/*
+ * printtouch - prints how each trace's time splits between the mm
+ *     calls themselves and writing the payloads, with the throughput
+ *     of the allocator calls alone
+ */
+static void printtouch(int n, stats_t *stats) {
+    int i;
+    double secs = 0, touch = 0, ops = 0, alloc;
+
+    printf("\n%6s %-19s%12s%12s%12s%11s\n", "trace#", " name",
+           "secs", "touch secs", "alloc secs", "alloc Kops");
+    printf("-----------------------------------------------------------------------------\n");
+    for (i = 0; i < n; i++) {
+        if (!stats[i].valid)
+            continue;
+        printf(" %-2d     %-19s%12.6f%12.6f%12.6f%11.0f\n", i,
+               stats[i].trace_name, stats[i].secs, stats[i].touch_secs,
+               alloc_secs(&stats[i]),
+               (stats[i].ops / 1e3) / alloc_secs(&stats[i]));
+        secs += stats[i].secs;
+        touch += stats[i].touch_secs;
+        ops += stats[i].ops;
+    }
+    /* as in alloc_secs, a replay slower than the run leaves no time */
+    alloc = (secs > touch) ? secs - touch : 0;
+    printf("%-26s%12.6f%12.6f%12.6f%11.0f\n", "Total", secs, touch,
+           alloc, (ops / 1e3) / alloc);
+}
+
+/*
+ * printhuge - prints how much of each trace's heap ended up on huge
+ *     pages (-P) next to its dTLB misses per op, to be compared with a
+ *     run without -P
+ */
+static void printhuge(int n, stats_t *stats) {
+    int i;
+    double dtlb, pct;
+
+    printf("\n%6s %-19s%12s%12s%8s%12s\n", "trace#", " name",
+           "heap MB", "huge MB", "huge%", "dTLB/op");
+    printf("---------------------------------------------------------------------\n");
+    for (i = 0; i < n; i++) {
+        if (!stats[i].valid)
+            continue;
+        dtlb = stats[i].counters[PERFCTR_DTLB_MISSES];
+        /* huge pages left by an earlier, larger trace may cover more */
+        pct = (stats[i].heap_bytes > 0) ?
+              100.0 * stats[i].huge_bytes / stats[i].heap_bytes : 0.0;
+        printf(" %-2d     %-19s%12.1f%12.1f%8.1f", i, stats[i].trace_name,
+               stats[i].heap_bytes / (1 << 20),
+               stats[i].huge_bytes / (1 << 20), (pct < 100) ? pct : 100);
+        if (dtlb < 0 || !perfcounters)
+            printf("%12s\n", "-");
+        else
+            printf("%12.3f\n", dtlb / stats[i].ops);
+    }
+}
+
+/*
+ * printresident - prints each trace's peak heap size next to how much
+ *     of it was still resident after the speed run (-D), to compare
+ *     page release thresholds
+ */
+static void printresident(int n, stats_t *stats) {
+    int i;
+    double heap = 0, resident = 0;
+
+    printf("\n%6s %-19s%12s%12s%8s\n", "trace#", " name",
+           "mapped MB", "resident MB", "res%");
+    printf("-----------------------------------------------------------\n");
+    for (i = 0; i < n; i++) {
+        if (!stats[i].valid)
+            continue;
+        printf(" %-2d     %-19s%12.2f%12.2f%8.1f\n", i, stats[i].trace_name,
+               stats[i].heap_bytes / (1 << 20),
+               stats[i].resident_bytes / (1 << 20),
+               stats[i].heap_bytes > 0 ?
+               100.0 * stats[i].resident_bytes / stats[i].heap_bytes : 0.0);
+        heap += stats[i].heap_bytes;
+        resident += stats[i].resident_bytes;
+    }
+    printf("%-26s%12.2f%12.2f%8.1f\n", "Total", heap / (1 << 20),
+           resident / (1 << 20), heap > 0 ? 100.0 * resident / heap : 0.0);
+}
+
+/*
+ * printfirst - prints the first timed run of each trace next to the
+ *     steady-state time the timing package settled on, with the page
+ *     faults each took (-F)
+ */
+static void printfirst(int n, stats_t *stats) {
+    int i;
+
+    printf("\n%6s %-19s%12s%12s%8s%11s%11s\n", "trace#", " name",
+           "first secs", "steady secs", "ratio", "first flt", "steady flt");
+    printf("-----------------------------------------------------------------------------------\n");
+    for (i = 0; i < n; i++) {
+        if (!stats[i].valid)
+            continue;
+        printf(" %-2d     %-19s%12.6f%12.6f%8.2f%11.0f%11.0f\n", i,
+               stats[i].trace_name, stats[i].first_secs, stats[i].secs,
+               stats[i].secs > 0 ? stats[i].first_secs / stats[i].secs : 0.0,
+               stats[i].first_faults, stats[i].steady_faults);
+    }
+}
+
+/*
+ * printsnapshot - prints, for each trace, the time to rebuild its heap
+ *     at the peak by replay next to the time to restore a snapshot of
+ *     it, and the snapshot's size (-X)
+ */
+static void printsnapshot(int n, stats_t *stats) {
+    int i;
+
+    printf("\n%6s %-19s%10s%12s%14s%14s%9s\n", "trace#", " name",
+           "peak op", "snap MB", "rebuild secs", "restore secs", "speedup");
+    printf("-----------------------------------------------------------------------------------\n");
+    for (i = 0; i < n; i++) {
+        if (!stats[i].valid)
+            continue;
+        printf(" %-2d     %-19s%10d%12.2f%14.6f%14.6f%9.1f\n", i,
+               stats[i].trace_name, stats[i].peak_op,
+               stats[i].snapshot_bytes / (1 << 20), stats[i].rebuild_secs,
+               stats[i].restore_secs, stats[i].restore_secs > 0 ?
+               stats[i].rebuild_secs / stats[i].restore_secs : 0.0);
+    }
+}
+
+/*
+ * alloc_secs - Time a trace spent inside the mm calls, i.e. its speed
+ *     run less the touch-only replay (-A)
+ */
+static double alloc_secs(stats_t *stats) {
+    double secs = stats->secs - stats->touch_secs;
+    return (secs > 0) ? secs : 0;
+}
+
+/*
+ * printratios - prints the mm and libc throughput on each trace and
+ *     their ratio, without the cap the perf index puts on throughput
+ */
+static void printratios(int n, stats_t *stats, stats_t *libc_stats) {
+    int i;
+
+    printf("\n%6s %-19s%12s%12s%10s\n", "trace#", " name", "mm Kops",
+           "libc Kops", "vs libc");
+    printf("-------------------------------------------------------------\n");
+    for (i = 0; i < n; i++) {
+        if (!stats[i].valid || !libc_stats[i].valid)
+            continue;
+        printf(" %-2d     %-19s%12.0f%12.0f%9.2fx\n", i, stats[i].trace_name,
+               (stats[i].ops / 1e3) / stats[i].secs,
+               (libc_stats[i].ops / 1e3) / libc_stats[i].secs,
+               stats[i].libc_ratio);
+    }
+    printf("\n");
+}
+
+/*
+ * printbackends - Compare every allocator evaluated in this run: the
+ *     traces each ran correctly, its weighted utilization over all the
+ *     traces, its weighted throughput over the valid ones, and the worst
+ *     per-trace median and 99th percentile op latency
+ */
+static void printbackends(int nb, backend_t **backends, int n,
+                          stats_t **stats) {
+    int b, i, valid;
+    double util, throughput, p50, p99;
+
+    printf("\n%-30s%8s%8s%10s%10s%10s\n", "backend", "valid", "util",
+           "Kops", "p50 ns", "p99 ns");
+    printf("-----------------------------------------------------------------------------\n");
+    for (b = 0; b < nb; b++) {
+        valid = 0;
+        p50 = p99 = 0;
+        weighted_totals(n, stats[b], &util, &throughput);
+        for (i = 0; i < n; i++) {
+            if (!stats[b][i].valid)
+                continue;
+            valid++;
+            if (stats[b][i].p50_ns > p50)
+                p50 = stats[b][i].p50_ns;
+            if (stats[b][i].p99_ns > p99)
+                p99 = stats[b][i].p99_ns;
+        }
+        printf("%-30.30s%5d/%-2d%7.0f%%%10.0f%10.0f%10.0f\n",
+               backends[b]->name, valid, n, 100.0 * util, throughput / 1e3,
+               p50, p99);
+    }
+    printf("\n");
+}
+
+/*
+ * trace_weight - The weight of a trace: the last -w given for it, by
+ *     path or by file name, or else the weight in its header
+ */
+static double trace_weight(char *tracefile, int header_weight) {
+    char *name = strrchr(tracefile, '/');
+    int i;
+
+    name = (name == NULL) ? tracefile : name + 1;
+    for (i = num_weights - 1; i >= 0; i--)
+        if (!strcmp(weight_names[i], tracefile) ||
+                !strcmp(weight_names[i], name))
+            return weight_values[i];
+    return header_weight;
+}
+
+/*
+ * weighted_totals - The weighted mean utilization over all n traces
+ *     (an invalid trace counts as 0), and the weighted throughput over
+ *     the valid ones, sum(w * ops) / sum(w * secs). With equal weights
+ *     these are the plain mean and total ops / total secs. If no trace
+ *     has a positive weight, every trace counts equally.
+ */
+static void weighted_totals(int n, stats_t *stats, double *util,
+                            double *throughput) {
+    double w, wsum = 0, wutil = 0, wops = 0, wsecs = 0;
+    int i, equal = 1;
+
+    for (i = 0; i < n; i++)
+        if (stats[i].weight > 0)
+            equal = 0;
+    for (i = 0; i < n; i++) {
+        w = equal ? 1 : ((stats[i].weight > 0) ? stats[i].weight : 0);
+        wsum += w;
+        if (!stats[i].valid)
+            continue;
+        wutil += w * stats[i].util;
+        wops += w * stats[i].ops;
+        wsecs += w * stats[i].secs;
+    }
+    *util = (wsum > 0) ? wutil / wsum : 0;
+    *throughput = (wsecs > 0) ? wops / wsecs : 0;
+}
+
+/*
+ * parse_bytes - Parse a byte count with an optional K, M, or G suffix,
+ *     exiting on anything else or a count that does not fit a size_t
+ */
+static size_t parse_bytes(char *s) {
+    size_t n;
+
+    if (mem_parse_size(s, &n) < 0) {
+        sprintf(msg, "Bad byte count: %.900s", s);
+        app_error(msg);
+    }
+    return n;
+}
+
+static int double_cmp(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * write_results - Save per-trace stats, the timing method, and host
+ *     info to filename. Files ending in ".json" are written as JSON,
+ *     everything else as CSV with "#"-prefixed metadata lines.
+ */
+static void write_results(char *filename, int n, stats_t *stats) {
+    FILE *fp;
+    struct utsname host;
+    char date[64];
+    time_t now = time(NULL);
+    size_t len = strlen(filename);
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int json = (len >= 5 && strcmp(filename + len - 5, ".json") == 0);
+    int i, j;
+
+    if ((fp = fopen(filename, "w")) == NULL) {
+        sprintf(msg, "Could not open %s in write_results", filename);
+        unix_error(msg);
+    }
+    if (uname(&host) < 0)
+        memset(&host, 0, sizeof(host));
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+    if (json) {
+        fprintf(fp, "{\n");
+        fprintf(fp, "  \"timing\": \"%s\",\n", fsecs_method());
+        fprintf(fp, "  \"date\": \"%s\",\n", date);
+        fprintf(fp, "  \"host\": {\"nodename\": ");
+        json_string(fp, host.nodename);
+        fprintf(fp, ", \"sysname\": ");
+        json_string(fp, host.sysname);
+        fprintf(fp, ", \"release\": ");
+        json_string(fp, host.release);
+        fprintf(fp, ", \"machine\": ");
+        json_string(fp, host.machine);
+        fprintf(fp, ", \"cpus\": %ld},\n", cpus);
+        fprintf(fp, "  \"traces\": [\n");
+        for (i = 0; i < n; i++) {
+            fprintf(fp, "    {\"trace\": %d, \"name\": ", i);
+            json_string(fp, stats[i].trace_name);
+            fprintf(fp, ", \"valid\": %d, "
+                    "\"ops\": %.0f, \"secs\": %.9f, \"secs_sd\": %.9f, "
+                    "\"samples\": %d, \"util\": %.6f, \"kops\": %.3f, "
+                    "\"weight\": %g, \"libc_ratio\": %.3f",
+                    stats[i].valid, stats[i].ops,
+                    stats[i].secs, stats[i].secs_sd, stats[i].samples,
+                    stats[i].util,
+                    stats[i].valid ? (stats[i].ops / 1e3) / stats[i].secs : 0,
+                    stats[i].weight, stats[i].libc_ratio);
+            if (split_touch)
+                fprintf(fp, ", \"touch_secs\": %.9f, \"alloc_secs\": %.9f",
+                        stats[i].touch_secs, alloc_secs(&stats[i]));
+            if (prefault != NULL)
+                fprintf(fp, ", \"first_secs\": %.9f, \"first_faults\": %.0f, "
+                        "\"steady_faults\": %.0f", stats[i].first_secs,
+                        stats[i].first_faults, stats[i].steady_faults);
+            if (snapshot)
+                fprintf(fp, ", \"peak_op\": %d, \"snapshot_bytes\": %.0f, "
+                        "\"rebuild_secs\": %.9f, \"restore_secs\": %.9f",
+                        stats[i].peak_op, stats[i].snapshot_bytes,
+                        stats[i].rebuild_secs, stats[i].restore_secs);
+            if (perfcounters)
+                for (j = 0; j < PERFCTR_NUM; j++)
+                    fprintf(fp, ", \"%s\": %.0f", perfctr_names[j],
+                            stats[i].counters[j]);
+            fprintf(fp, "}%s\n", (i == n - 1) ? "" : ",");
+        }
+        fprintf(fp, "  ]\n}\n");
+    }
+    else {
+        fprintf(fp, "# timing: %s\n", fsecs_method());
+        fprintf(fp, "# date: %s\n", date);
+        fprintf(fp, "# host: %s %s %s %s cpus=%ld\n", host.nodename,
+                host.sysname, host.release, host.machine, cpus);
+        fprintf(fp, "trace,name,valid,ops,secs,secs_sd,samples,util,kops,weight,libc_ratio");
+        if (split_touch)
+            fprintf(fp, ",touch_secs,alloc_secs");
+        if (prefault != NULL)
+            fprintf(fp, ",first_secs,first_faults,steady_faults");
+        if (snapshot)
+            fprintf(fp, ",peak_op,snapshot_bytes,rebuild_secs,restore_secs");
+        if (perfcounters)
+            for (j = 0; j < PERFCTR_NUM; j++)
+                fprintf(fp, ",%s", perfctr_names[j]);
+        fprintf(fp, "\n");
+        for (i = 0; i < n; i++) {
+            fprintf(fp, "%d,", i);
+            csv_field(fp, stats[i].trace_name);
+            fprintf(fp, ",%d,%.0f,%.9f,%.9f,%d,%.6f,%.3f,%g,%.3f",
+                    stats[i].valid, stats[i].ops,
+                    stats[i].secs, stats[i].secs_sd, stats[i].samples,
+                    stats[i].util,
+                    stats[i].valid ? (stats[i].ops / 1e3) / stats[i].secs : 0,
+                    stats[i].weight, stats[i].libc_ratio);
+            if (split_touch)
+                fprintf(fp, ",%.9f,%.9f", stats[i].touch_secs,
+                        alloc_secs(&stats[i]));
+            if (prefault != NULL)
+                fprintf(fp, ",%.9f,%.0f,%.0f", stats[i].first_secs,
+                        stats[i].first_faults, stats[i].steady_faults);
+            if (snapshot)
+                fprintf(fp, ",%d,%.0f,%.9f,%.9f", stats[i].peak_op,
+                        stats[i].snapshot_bytes, stats[i].rebuild_secs,
+                        stats[i].restore_secs);
+            if (perfcounters)
+                for (j = 0; j < PERFCTR_NUM; j++)
+                    fprintf(fp, ",%.0f", stats[i].counters[j]);
+            fprintf(fp, "\n");
+        }
+    }
+    fclose(fp);
+}
+
+/*
+ * json_string - Write s to fp as a JSON string, quoted and escaped
+ */
+static void json_string(FILE *fp, const char *s) {
+    putc('"', fp);
+    for (; *s != '\0'; s++) {
+        if (*s == '"' || *s == '\\')
+            fprintf(fp, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            fprintf(fp, "\\u%04x", (unsigned char)*s);
+        else
+            putc(*s, fp);
+    }
+    putc('"', fp);
+}
+
+/*
+ * csv_field - Write s to fp as one CSV field, in double quotes with
+ *     any quote doubled if it holds a comma, quote or line break
+ */
+static void csv_field(FILE *fp, const char *s) {
+    if (s[strcspn(s, ",\"\r\n")] == '\0') {
+        fputs(s, fp);
+        return;
+    }
+    putc('"', fp);
+    for (; *s != '\0'; s++) {
+        if (*s == '"')
+            putc('"', fp);
+        putc(*s, fp);
+    }
+    putc('"', fp);
+}
+
+/*
+ * csv_split - Split a CSV line in place into at most max fields,
+ *     unquoting the fields csv_field quoted. Returns the field count.
+ */
+static int csv_split(char *line, char **fields, int max) {
+    char *in = line, *out;
+    int n = 0;
+
+    while (n < max) {
+        fields[n++] = out = in;
+        if (*in == '"') {
+            for (in++; *in != '\0'; in++) {
+                if (*in == '"' && *++in != '"')
+                    break;
+                *out++ = *in;
+            }
+        }
+        while (*in != '\0' && *in != ',')
+            *out++ = *in++;
+        if (*in == '\0') {
+            *out = '\0';
+            break;
+        }
+        *out = '\0';
+        in++;
+    }
+    return n;
+}
+
+/*
+ * compare_baseline - Load a CSV file written by write_results and
+ *     report every trace whose util or throughput dropped by more than
+ *     threshold percent. Returns the number of regressions found.
+ */
+static int compare_baseline(char *filename, int n, stats_t *stats,
+                            double threshold) {
+    FILE *fp;
+    char line[MAXLINE];
+    char *fields[32];
+    int name_col = -1, valid_col = -1, util_col = -1, kops_col = -1;
+    int nfields, i;
+    int regressions = 0;
+    double base_util, base_kops, cur_kops, drop;
+
+    if ((fp = fopen(filename, "r")) == NULL) {
+        sprintf(msg, "Could not open %s in compare_baseline", filename);
+        unix_error(msg);
+    }
+
+    while (fgets(line, MAXLINE, fp) != NULL) {
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+        line[strcspn(line, "\r\n")] = '\0';
+
+        /* Split the row into comma-separated fields */
+        nfields = csv_split(line, fields, 32);
+
+        /* The first row names the columns */
+        if (name_col < 0) {
+            for (i = 0; i < nfields; i++) {
+                if (!strcmp(fields[i], "name"))  name_col = i;
+                if (!strcmp(fields[i], "valid")) valid_col = i;
+                if (!strcmp(fields[i], "util"))  util_col = i;
+                if (!strcmp(fields[i], "kops"))  kops_col = i;
+            }
+            if (name_col < 0 || valid_col < 0 || util_col < 0 || kops_col < 0)
+                app_error("Baseline file is missing a name/valid/util/kops column");
+            continue;
+        }
+        if (nfields <= name_col || nfields <= valid_col ||
+                nfields <= util_col || nfields <= kops_col ||
+                !atoi(fields[valid_col]))
+            continue;
+
+        /* Find the matching trace in this run */
+        for (i = 0; i < n; i++)
+            if (!strcmp(stats[i].trace_name, fields[name_col]))
+                break;
+        if (i == n)
+            continue;
+
+        if (!stats[i].valid) {
+            printf("REGRESSION %s: no longer consistent\n", stats[i].trace_name);
+            regressions++;
+            continue;
+        }
+
+        base_util = atof(fields[util_col]);
+        if (base_util > 0) {
+            drop = 100.0 * (base_util - stats[i].util) / base_util;
+            if (drop > threshold) {
+                printf("REGRESSION %s: util %.1f%% -> %.1f%% (-%.1f%%)\n",
+                       stats[i].trace_name, base_util * 100.0,
+                       stats[i].util * 100.0, drop);
+                regressions++;
+            }
+        }
+
+        base_kops = atof(fields[kops_col]);
+        cur_kops = (stats[i].ops / 1e3) / stats[i].secs;
+        if (base_kops > 0) {
+            drop = 100.0 * (base_kops - cur_kops) / base_kops;
+            if (drop > threshold) {
+                printf("REGRESSION %s: Kops %.0f -> %.0f (-%.1f%%)\n",
+                       stats[i].trace_name, base_kops, cur_kops, drop);
+                regressions++;
+            }
+        }
+    }
+    fclose(fp);
+
+    if (regressions == 0)
+        printf("No regressions against %s (threshold %.1f%%)\n",
+               filename, threshold);
+    return regressions;
+}
+
 /*
  * app_error - Report an arbitrary application error
  */
@@ -984,13 +2449,62 @@ void malloc_error(int tracenum, int opnum, char *msg) {
  * usage - Explain the command line arguments
  */
 static void usage(void) {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hvValpAHLPX] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "               [-o <file>] [-b <file>] [-r <pct>] [-s <n>] [-j <n>]\n");
+    fprintf(stderr, "               [-T <method>] [-k <K>] [-e <eps>] [-n <n>] [-C <cold|warm>]\n");
+    fprintf(stderr, "               [-S <bytes>] [-m <mode>] [-D <bytes>] [-F <mode>] [-R <Kops|libc>]\n");
+    fprintf(stderr, "               [-Z <bytes>] [-w <trace>=<weight>]... [-B <so>]...\n");
     fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-A         Report allocator time apart from payload-touch time.\n");
+    fprintf(stderr, "\t-b <file>  Compare against a baseline saved with -o (CSV).\n");
+    fprintf(stderr, "\t           Exits with status 2 if any trace regressed.\n");
+    fprintf(stderr, "\t-B <so>    Also run the mm variant in <so> (make mmXXX.so) and\n");
+    fprintf(stderr, "\t           compare all allocators in one table. Repeatable.\n");
+    fprintf(stderr, "\t-C <cold|warm>  Clear the cache before each fcyc sample or not.\n");
+    fprintf(stderr, "\t-D <bytes> Give back the pages inside free blocks of at least\n");
+    fprintf(stderr, "\t           <bytes> (default 0, never) and report resident\n");
+    fprintf(stderr, "\t           vs. mapped heap bytes (with -v).\n");
+    fprintf(stderr, "\t-e <eps>   Tolerance for the K-best scheme.\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
+    fprintf(stderr, "\t-F <mode>  Prefault the heap up to each trace's peak before timing\n");
+    fprintf(stderr, "\t           it (touch), also mlock it (lock), or neither (none),\n");
+    fprintf(stderr, "\t           and report the first run apart from the steady state\n");
+    fprintf(stderr, "\t           (with -v).\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
-    fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-H         Presize the heap with mm_init_hint from each trace's\n");
+    fprintf(stderr, "\t           suggested heap size.\n");
+    fprintf(stderr, "\t-j <n>     Run the mm traces in <n> worker processes, one\n");
+    fprintf(stderr, "\t           per core.\n");
+    fprintf(stderr, "\t-k <K>     K in the K-best scheme.\n");
+    fprintf(stderr, "\t-L         Use the large-heap traces in the trace directory\n");
+    fprintf(stderr, "\t           (make large-traces), with a 16G heap unless -S.\n");
+    fprintf(stderr, "\t-l         Print the libc malloc results as well (with -v).\n");
+    fprintf(stderr, "\t-m <mode>  Back the heap with malloc, map (mmap, the default),\n");
+    fprintf(stderr, "\t           reserve (mmap PROT_NONE, committed as the brk moves),\n");
+    fprintf(stderr, "\t           or file (a shared mapping of a file in /tmp).\n");
+    fprintf(stderr, "\t-n <n>     Max samples for fcyc, or runs averaged by the other timers.\n");
+    fprintf(stderr, "\t-o <file>  Write per-trace results as CSV (or JSON if <file>\n");
+    fprintf(stderr, "\t           ends in .json).\n");
+    fprintf(stderr, "\t-p         Report hardware performance counters per op.\n");
+    fprintf(stderr, "\t-P         Back the heap with 2M huge pages (hugetlbfs if reserved,\n");
+    fprintf(stderr, "\t           else THP) and report huge page coverage and dTLB\n");
+    fprintf(stderr, "\t           misses per op (with -v).\n");
+    fprintf(stderr, "\t-r <pct>   Regression threshold in percent for -b (default 5).\n");
+    fprintf(stderr, "\t-R <Kops|libc> Throughput that earns full credit in the perf\n");
+    fprintf(stderr, "\t           index (default libc, measured on this host).\n");
+    fprintf(stderr, "\t-S <bytes> Heap size limit, with an optional K, M, or G suffix\n");
+    fprintf(stderr, "\t           (default 20M).\n");
+    fprintf(stderr, "\t-s <n>     Write a <trace>.timeline.csv fragmentation sample\n");
+    fprintf(stderr, "\t           every <n> ops.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+    fprintf(stderr, "\t-T <method> Timing method: fcyc, itimer, gettod, or clock.\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
+    fprintf(stderr, "\t-w <trace>=<weight> Weight of <trace> in the perf index,\n");
+    fprintf(stderr, "\t           instead of the one in its header. Repeatable.\n");
+    fprintf(stderr, "\t-X         Time restoring a snapshot of each trace's heap at its\n");
+    fprintf(stderr, "\t           peak against replaying the trace up to there (with -v).\n");
+    fprintf(stderr, "\t-Z <bytes> Give blocks of at least <bytes> a mapping of their own,\n");
+    fprintf(stderr, "\t           which realloc resizes with mremap instead of copying.\n");
 }
@@ -0,0 +1,275 @@
+/*
+ * mdshm.c - Compare passing buffers between processes through a shared
+ *     mm heap (mmshm.c) with copying them through a pipe.
+ *
+ * A producer process sends n messages of a fixed size to a consumer it
+ * forks, which reads every byte of each one. Through the pipe, each
+ * message is written into the kernel and read back out of it again:
+ * two copies. Through the shared heap, the producer mmshm_mallocs the
+ * message, writes it in place and sends just its offset down a pipe;
+ * the consumer, which maps the heap on its own at whatever address it
+ * gets, reads the message where it is and mmshm_frees it. At most a
+ * window of messages is in flight, so the heap stays small.
+ *
+ * Both runs fill and check the same bytes, so the difference between
+ * them is the cost of the copies, and of the pipe traffic and locking
+ * that replace them.
+ */
+#define _GNU_SOURCE /* for F_SETPIPE_SZ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "mmshm.h"
+#include "memlib.h"
+
+#define MAXLINE   1024 /* max string size */
+#define PIPE_SIZE (1 << 20) /* pipe buffer we ask for, if we may */
+
+static char shm_name[MAXLINE]; /* the heap run_shm created, until unlinked */
+
+static double run_pipe(long n, size_t size);
+static double run_shm(long n, size_t size, int window);
+static int consume(char *buf, size_t size, long i);
+static void write_all(int fd, void *buf, size_t n);
+static int read_all(int fd, void *buf, size_t n);
+static double now(void);
+static size_t parse_bytes(char *s);
+static void usage(void);
+static void app_error(char *msg);
+
+int main(int argc, char **argv) {
+    long n = 1000;
+    size_t size = 1 << 20;
+    int window = 8;
+    double pipe_secs, shm_secs, gb;
+    int c;
+
+    while ((c = getopt(argc, argv, "n:s:w:h")) != EOF) {
+        switch (c) {
+        case 'n': /* Number of messages */
+            if ((n = atol(optarg)) < 1)
+                app_error("-n must be at least 1");
+            break;
+        case 's': /* Message size */
+            if ((size = parse_bytes(optarg)) == 0)
+                app_error("-s must be at least 1");
+            break;
+        case 'w': /* Messages in flight */
+            if ((window = atoi(optarg)) < 1)
+                app_error("-w must be at least 1");
+            break;
+        case 'h': /* Print this message */
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+
+    pipe_secs = run_pipe(n, size);
+    shm_secs = run_shm(n, size, window);
+    gb = (double)n * size / 1e9;
+    printf("%ld messages of %zu bytes, window %d\n", n, size, window);
+    printf("%-14s%10s%10s\n", "", "secs", "GB/s");
+    printf("%-14s%10.3f%10.2f\n", "pipe copy", pipe_secs, gb / pipe_secs);
+    printf("%-14s%10.3f%10.2f%8.1fx\n", "shared heap", shm_secs,
+           gb / shm_secs, pipe_secs / shm_secs);
+    exit(0);
+}
+
+/*
+ * run_pipe - Send the messages through a pipe and return the seconds
+ *     until the consumer has read them all
+ */
+static double run_pipe(long n, size_t size) {
+    int fds[2], status;
+    double start;
+    char *buf;
+    pid_t pid;
+    long i;
+
+    if ((buf = malloc(size)) == NULL)
+        app_error("Out of memory");
+    if (pipe(fds) < 0)
+        app_error("pipe failed");
+    fcntl(fds[1], F_SETPIPE_SZ, PIPE_SIZE);  /* best effort */
+
+    start = now();
+    if ((pid = fork()) < 0)
+        app_error("fork failed");
+    if (pid == 0) {
+        close(fds[1]);
+        for (i = 0; i < n; i++)
+            if (read_all(fds[0], buf, size) < 0 || !consume(buf, size, i))
+                _exit(1);
+        _exit(0);
+    }
+    close(fds[0]);
+    for (i = 0; i < n; i++) {
+        memset(buf, i & 0xFF, size);
+        write_all(fds[1], buf, size);
+    }
+    close(fds[1]);
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+            WEXITSTATUS(status) != 0)
+        app_error("The pipe consumer failed");
+    free(buf);
+    return now() - start;
+}
+
+/*
+ * run_shm - Send the messages as offsets into a shared heap and return
+ *     the seconds until the consumer has read and freed them all
+ */
+static double run_shm(long n, size_t size, int window) {
+    char *name = shm_name;
+    int data[2], acks[2], status;
+    size_t offset, heap;
+    double start, secs;
+    char *p, ack = 0;
+    pid_t pid;
+    long i;
+
+    /* room for the window twice over, whatever the fragmentation */
+    heap = 2 * (size_t)window * (size + 64) + (1 << 20);
+    sprintf(name, "/mdshm.%d", (int)getpid());
+    if (mmshm_create(name, heap) < 0)
+        app_error("Could not create the shared heap");
+    if (pipe(data) < 0 || pipe(acks) < 0)
+        app_error("pipe failed");
+
+    start = now();
+    if ((pid = fork()) < 0)
+        app_error("fork failed");
+    if (pid == 0) {
+        /* map the heap anew rather than use the copy fork gave us */
+        mmshm_close();
+        if (mmshm_open(name) < 0)
+            _exit(1);
+        name[0] = '\0';  /* the parent unlinks it, even if we fail */
+        close(data[1]);
+        close(acks[0]);
+        for (i = 0; i < n; i++) {
+            if (read_all(data[0], &offset, sizeof(offset)) < 0)
+                _exit(1);
+            p = mmshm_pointer(offset);
+            if (!consume(p, size, i))
+                _exit(1);
+            mmshm_free(p);
+            write_all(acks[1], &ack, 1);
+        }
+        _exit(0);
+    }
+    close(data[0]);
+    close(acks[1]);
+    for (i = 0; i < n; i++) {
+        if (i >= window && read_all(acks[0], &ack, 1) < 0)
+            app_error("The shared heap consumer quit early");
+        if ((p = mmshm_malloc(size)) == NULL)
+            app_error("mmshm_malloc failed");
+        memset(p, i & 0xFF, size);
+        offset = mmshm_offset(p);
+        write_all(data[1], &offset, sizeof(offset));
+    }
+    close(data[1]);
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+            WEXITSTATUS(status) != 0)
+        app_error("The shared heap consumer failed");
+    secs = now() - start;
+    close(acks[0]);
+    mmshm_close();
+    shm_unlink(name);
+    name[0] = '\0';
+    return secs;
+}
+
+/*
+ * consume - Read every byte of message i, returning 1 if it holds what
+ *     the producer wrote, 0 if not
+ */
+static int consume(char *buf, size_t size, long i) {
+    unsigned long long sum = 0, word;
+    size_t j, words = size / sizeof(word);
+
+    for (j = 0; j < words; j++) {
+        memcpy(&word, buf + j * sizeof(word), sizeof(word));
+        sum += word;
+    }
+    memset(&word, i & 0xFF, sizeof(word));
+    return sum == words * word && (buf[size - 1] & 0xFF) == (i & 0xFF);
+}
+
+/* write_all - Write n bytes to fd, exiting on error */
+static void write_all(int fd, void *buf, size_t n) {
+    ssize_t done;
+
+    while (n > 0) {
+        if ((done = write(fd, buf, n)) <= 0)
+            app_error("write failed");
+        buf = (char *)buf + done;
+        n -= done;
+    }
+}
+
+/* read_all - Read n bytes from fd. Returns 0, or -1 on error or EOF. */
+static int read_all(int fd, void *buf, size_t n) {
+    ssize_t done;
+
+    while (n > 0) {
+        if ((done = read(fd, buf, n)) <= 0)
+            return -1;
+        buf = (char *)buf + done;
+        n -= done;
+    }
+    return 0;
+}
+
+/* now - Seconds on the monotonic clock */
+static double now(void) {
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/*
+ * parse_bytes - Parse a byte count with an optional K, M, or G suffix,
+ *     exiting on anything else
+ */
+static size_t parse_bytes(char *s) {
+    size_t n;
+
+    if (mem_parse_size(s, &n) < 0)
+        app_error("Bad byte count");
+    return n;
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void) {
+    fprintf(stderr, "Usage: mdshm [-h] [-n <msgs>] [-s <bytes>] [-w <msgs>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h          Print this message.\n");
+    fprintf(stderr, "\t-n <msgs>   Number of messages to send (1000).\n");
+    fprintf(stderr, "\t-s <bytes>  Size of each message, with an optional K, M,\n");
+    fprintf(stderr, "\t            or G suffix (1M).\n");
+    fprintf(stderr, "\t-w <msgs>   Most messages in flight in the shared heap (8).\n");
+}
+
+/*
+ * app_error - Report an error and exit
+ */
+static void app_error(char *msg) {
+    fprintf(stderr, "mdshm: %s\n", msg);
+    if (shm_name[0] != '\0')
+        shm_unlink(shm_name);
+    exit(1);
+}
@@ -3,21 +3,248 @@
  *            allows us to interleave calls from the student's malloc package 
  *            with the system's malloc package in libc.
  */
+#define _GNU_SOURCE /* for mremap */
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <assert.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include "memlib.h"
 #include "config.h"
 
-/* private variables */
+/* private variables, for the segment mem_sbrk moves */
 static char *mem_start_brk;  /* points to first byte of heap */
 static char *mem_brk;        /* points to last byte of heap */
 static char *mem_max_addr;   /* largest legal heap address */ 
+static size_t mem_max_heap = MAX_HEAP; /* heap size limit in bytes */
+static int mem_mapped = 0;   /* 1 if the heap was set up by mem_init_vm */
+static int mem_reserved = 0; /* 1 if the heap was set up by mem_init_reserve */
+static int mem_file = -1;    /* file behind the heap (mem_init_file), or -1 */
+static size_t mem_file_off = 0; /* where the heap starts in that file */
+static char *mem_commit_brk; /* end of the committed pages (mem_reserved) */
+static size_t mem_peak = 0;  /* largest heap size since the last reset */
+static size_t mem_seg_peak = 0; /* largest size of this segment since then */
+static int mem_huge = 0;     /* back the heap with huge pages (mem_set_hugepages) */
+static int mem_map_flags;    /* mmap flags the heap was mapped with */
+static size_t mem_map_size;  /* bytes mapped for the heap */
+static char *mem_pinned_end = NULL; /* end of the prefaulted pages in this segment */
+
+/* A segment handed out before the current one (see mem_new_segment) */
+typedef struct {
+    char *start;     /* first byte */
+    char *brk;       /* end of its heap, which no longer moves */
+    char *max_addr;  /* its limit, so it can be made current again */
+    char *commit_brk; /* end of its committed pages (mem_reserved) */
+    size_t map_size; /* bytes mapped or malloc'd for it */
+    size_t peak;     /* largest size it reached */
+    char *pinned_end; /* end of its prefaulted pages (mem_prefault) */
+} mem_seg_t;
+
+static mem_seg_t mem_segs[MEM_MAX_SEGMENTS - 1];
+static int mem_nsegs = 0;        /* segments in mem_segs */
+static size_t mem_seg_bytes = 0; /* heap bytes in mem_segs */
+
+/* Prefaulted segments mem_reset_brk kept for mem_new_segment to reuse */
+static mem_seg_t mem_spares[MEM_MAX_SEGMENTS - 1];
+static int mem_nspares = 0;
+static int mem_keep_segs = 0;    /* keep segments across resets (mem_prefault) */
+
+/* The page ahead of a heap shared between processes (mem_init_shm) */
+typedef struct {
+    pthread_mutex_t lock; /* process-shared, held around every change */
+    size_t brk;           /* heap bytes, as of the last mem_unlock */
+    size_t max_heap;      /* the limit every process maps */
+} mem_shm_t;
+
+static mem_shm_t *mem_shm = NULL; /* NULL if the heap is not shared */
+
+/* A block mapped on its own (mem_map_block), ahead of the bytes handed out */
+typedef struct mem_block {
+    struct mem_block *next; /* every mapped block, in no order */
+    struct mem_block *prev;
+    size_t size;            /* bytes mapped, this header included */
+} mem_block_t;
+
+static mem_block_t *mem_blocks = NULL; /* list of mapped blocks */
+static size_t mem_block_bytes = 0;     /* bytes mapped for them */
+
+/* A segment in a heap image (mem_save), and where mem_load put it */
+typedef struct {
+    char *start;     /* first byte when the image was saved */
+    size_t size;     /* heap bytes */
+} mem_image_t;
+
+static mem_image_t mem_images[MEM_MAX_SEGMENTS];
+static char *mem_loaded[MEM_MAX_SEGMENTS];
+static int mem_nimages = 0;
+
+/* Heap pages mem_load mapped from the image file, until the next reset */
+static char *mem_filemap_start[MEM_MAX_SEGMENTS];
+static size_t mem_filemap_span[MEM_MAX_SEGMENTS];
+static int mem_nfilemaps = 0;
+
+static int mem_commit(char *addr);
+static void mem_decommit(char *addr);
+static void mem_unmap_all(void);
+static void mem_drop_filemaps(void);
+
+/* smallest amount mem_sbrk commits at once in a reserved heap */
+#define MEM_COMMIT_UNIT (64 * 1024)
+
+/* size and alignment of a huge page */
+#define MEM_HUGE_PAGE ((size_t)2 * 1024 * 1024)
+
+
+
+/*
+ * mem_set_max_heap - set the heap size limit used by the next mem_init
+ *    or mem_init_vm call. Defaults to MAX_HEAP.
+ */
+void mem_set_max_heap(size_t bytes) {
+    mem_max_heap = bytes;
+}
+
+/*
+ * mem_parse_size - parse a decimal byte count such as a heap size,
+ *    with an optional K, M, or G suffix, into *bytes. It allocates
+ *    nothing and leaves errno alone, so it is safe inside malloc
+ *    (mmpreload.c).
+ *    Returns 0, or -1 for an unknown suffix, an empty or negative
+ *    count, or one too large for a size_t.
+ */
+int mem_parse_size(const char *s, size_t *bytes) {
+    int saved = errno, shift = 0, ok;
+    unsigned long long n;
+    char *end;
+
+    errno = 0;
+    n = strtoull(s, &end, 10);
+    switch (*end) {
+    case 'G': case 'g': shift += 10; /* fall through */
+    case 'M': case 'm': shift += 10; /* fall through */
+    case 'K': case 'k': shift += 10; end++;
+    }
+    ok = end != s && *end == '\0' && errno != ERANGE &&
+	strchr(s, '-') == NULL && n <= (SIZE_MAX >> shift);
+    errno = saved;
+    if (!ok)
+	return -1;
+    *bytes = (size_t)n << shift;
+    return 0;
+}
+
+
+
+
+/*
+ * mem_set_hugepages - if on, the next mem_init* call backs the heap with
+ *    2 MB-aligned memory: hugetlbfs pages (MAP_HUGETLB) when the host has
+ *    enough of them reserved for the whole limit, else transparent huge
+ *    pages (MADV_HUGEPAGE). A reserved heap then commits and decommits
+ *    whole huge pages.
+ */
+void mem_set_hugepages(int on) {
+    mem_huge = on;
+}
+
+/*
+ * mem_huge_up - round n up to a multiple of the huge page size
+ */
+static size_t mem_huge_up(size_t n) {
+    return (n + MEM_HUGE_PAGE - 1) & ~(MEM_HUGE_PAGE - 1);
+}
+
+/*
+ * mem_map - map size bytes of private anonymous memory for the heap,
+ *    huge page aligned if mem_huge is set. mem_map_size is the size
+ *    rounded up to whole pages. Returns NULL on failure.
+ */
+static char *mem_map(size_t size, int prot) {
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+    size_t page = mem_pagesize();
+    char *start, *aligned;
+
+    mem_map_flags = flags;
+    mem_map_size = size = (size + page - 1) & ~(page - 1);
+    if (!mem_huge) {
+	start = mmap(NULL, size, prot, flags, -1, 0);
+	return (start == MAP_FAILED) ? NULL : start;
+    }
+
+    /* hugetlbfs pages, reserved up front so a fault can never fail */
+    mem_map_size = size = mem_huge_up(size);
+    start = mmap(NULL, size, prot, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+		 -1, 0);
+    if (start != MAP_FAILED) {
+	mem_map_flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+	return start;
+    }
+
+    /* else over-map, trim to a 2 MB-aligned range, and ask for THP */
+    start = mmap(NULL, size + MEM_HUGE_PAGE, prot, flags, -1, 0);
+    if (start == MAP_FAILED)
+	return NULL;
+    aligned = (char *)mem_huge_up((size_t)start);
+    if (aligned > start)
+	munmap(start, aligned - start);
+    munmap(aligned + size, start + MEM_HUGE_PAGE - aligned);
+    madvise(aligned, size, MADV_HUGEPAGE);
+    return aligned;
+}
+
+
+
+
+/*
+ * mem_get_segment - get size bytes of storage for a heap segment the
+ *    way the heap was set up (mem_mapped, mem_reserved), setting
+ *    mem_map_size. Returns NULL on failure.
+ */
+static char *mem_get_segment(size_t size) {
+    void *start;
+
+    if (mem_mapped)
+	return mem_map(size, mem_reserved ? PROT_NONE : PROT_READ | PROT_WRITE);
+
+    mem_map_size = size;
+    if (!mem_huge)
+	return (char *)malloc(size);
+    mem_map_size = mem_huge_up(size);
+    if (posix_memalign(&start, MEM_HUGE_PAGE, mem_map_size) != 0)
+	return NULL;
+    madvise(start, mem_map_size, MADV_HUGEPAGE);
+    return (char *)start;
+}
+
+/*
+ * mem_put_segment - give back the storage of a segment
+ */
+static void mem_put_segment(char *start, size_t map_size) {
+    if (mem_mapped)
+	munmap(start, map_size);
+    else
+	free(start);
+}
+
+/*
+ * mem_use_segment - make the empty segment at start, of size bytes,
+ *    the one mem_sbrk moves
+ */
+static void mem_use_segment(char *start, size_t size) {
+    mem_start_brk = start;
+    mem_max_addr = start + size;  /* max legal heap address */
+    mem_brk = start;              /* heap is empty initially */
+    mem_commit_brk = start;       /* nothing committed yet (mem_reserved) */
+    mem_seg_peak = 0;
+}
+
 
 
 
@@ -25,14 +252,591 @@ static char *mem_max_addr;   /* largest legal heap address */
  * mem_init - initialize the memory system model
  */
 void mem_init(void) {
+    char *start;
+
     /* allocate the storage we will use to model the available VM */
-    if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
-	fprintf(stderr, "mem_init_vm: malloc error\n");
+    mem_mapped = 0;
+    mem_reserved = 0;
+    if ((start = mem_get_segment(mem_max_heap)) == NULL) {
+	fprintf(stderr, "mem_init: malloc error\n");
 	exit(1);
     }
+    mem_use_segment(start, mem_max_heap);
+    mem_nsegs = 0;
+    mem_seg_bytes = 0;
+}
+
+
+
+
+/*
+ * mem_init_vm - initialize the memory system model on a reserved range
+ *    of address space rather than a malloc'd buffer. Nothing is
+ *    committed until the heap is touched, and no malloc is called, so
+ *    this is safe to use when mm itself is the process's malloc.
+ */
+void mem_init_vm(void) {
+    char *start;
 
-    mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
-    mem_brk = mem_start_brk;                  /* heap is empty initially */
+    mem_mapped = 1;
+    mem_reserved = 0;
+    if ((start = mem_get_segment(mem_max_heap)) == NULL) {
+	fprintf(stderr, "mem_init_vm: mmap error\n");
+	exit(1);
+    }
+    mem_use_segment(start, mem_max_heap);
+    mem_nsegs = 0;
+    mem_seg_bytes = 0;
+}
+
+
+
+
+/*
+ * mem_init_reserve - initialize the memory system model on a reserved
+ *    range of address space with no access at all. mem_sbrk commits
+ *    pages with mprotect as the brk advances and decommits them when
+ *    it shrinks, so the process's RSS and commit charge follow the
+ *    heap size rather than the limit, and a limit far larger than
+ *    MAX_HEAP costs nothing up front.
+ */
+void mem_init_reserve(void) {
+    char *start;
+
+    mem_mapped = 1;
+    mem_reserved = 1;
+    if ((start = mem_get_segment(mem_max_heap)) == NULL) {
+	fprintf(stderr, "mem_init_reserve: mmap error\n");
+	exit(1);
+    }
+    mem_use_segment(start, mem_max_heap);
+    mem_nsegs = 0;
+    mem_seg_bytes = 0;
+}
+
+
+
+
+/*
+ * mem_init_file - initialize the memory system model on a shared mapping
+ *    of the file at path, created if need be, so that the heap outlives
+ *    the process. The file holds the committed part of the heap: as in
+ *    mem_init_reserve, mem_sbrk commits as the brk advances, here by
+ *    growing the file with ftruncate, and shrinking it when the brk
+ *    moves back. A file that already holds a heap is mapped with the
+ *    brk at the end of the file, from where the allocator can move it
+ *    back to where its own records say the heap ends. The file may be
+ *    mapped at a different address every time, and the heap is never
+ *    more than one segment. Returns 1 if the file held a heap, 0 if it
+ *    was empty, or -1 on error.
+ */
+int mem_init_file(const char *path) {
+    struct stat st;
+    char *start;
+    int fd;
+
+    if ((fd = open(path, O_RDWR | O_CREAT, 0600)) < 0)
+	return -1;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size > mem_max_heap ||
+	(start = mmap(NULL, mem_max_heap, PROT_READ | PROT_WRITE, MAP_SHARED,
+		      fd, 0)) == MAP_FAILED) {
+	if ((size_t)st.st_size > mem_max_heap)
+	    errno = EFBIG;
+	close(fd);
+	return -1;
+    }
+    mem_mapped = 1;
+    mem_reserved = 1;
+    mem_file = fd;
+    mem_map_flags = MAP_SHARED;
+    mem_map_size = mem_max_heap;
+    mem_use_segment(start, mem_max_heap);
+    mem_nsegs = 0;
+    mem_seg_bytes = 0;
+    mem_brk = mem_commit_brk = start + st.st_size;
+    mem_seg_peak = mem_peak = st.st_size;
+    return st.st_size > 0;
+}
+
+
+
+
+/*
+ * mem_init_shm - initialize the memory system model on the POSIX shared
+ *    memory object name, which create makes (and must not exist yet)
+ *    and other processes then open, so that they all allocate from one
+ *    heap. Each process maps the object wherever it can, so only
+ *    offsets from mem_heap_lo mean the same thing in all of them. The
+ *    first page of the object holds the brk and a process-shared lock;
+ *    the heap follows it and grows as in mem_init_file, except that it
+ *    never shrinks, because another process may still count on pages
+ *    this one has given up. Every change to the heap must be made
+ *    between mem_lock and mem_unlock. Opening takes the heap size limit
+ *    from the object, not from mem_set_max_heap. Returns 0, or -1 on
+ *    error.
+ */
+int mem_init_shm(const char *name, int create) {
+    size_t page = mem_pagesize();
+    pthread_mutexattr_t attr;
+    mem_shm_t *shm;
+    int fd;
+
+    if ((fd = shm_open(name, O_RDWR | (create ? O_CREAT | O_EXCL : 0),
+		       0600)) < 0)
+	return -1;
+    if (create) {
+	if (ftruncate(fd, page) < 0 ||
+	    (shm = mmap(NULL, page, PROT_READ | PROT_WRITE, MAP_SHARED,
+			fd, 0)) == MAP_FAILED) {
+	    close(fd);
+	    shm_unlink(name);
+	    return -1;
+	}
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+	pthread_mutex_init(&shm->lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+	shm->brk = 0;
+	shm->max_heap = mem_max_heap;
+    }
+    else if ((shm = mmap(NULL, page, PROT_READ | PROT_WRITE, MAP_SHARED,
+			 fd, 0)) == MAP_FAILED) {
+	close(fd);
+	return -1;
+    }
+    mem_max_heap = shm->max_heap;
+    munmap(shm, page);
+
+    /* map the header and the whole heap limit after it in one piece */
+    if ((shm = mmap(NULL, page + mem_max_heap, PROT_READ | PROT_WRITE,
+		    MAP_SHARED, fd, 0)) == MAP_FAILED) {
+	close(fd);
+	return -1;
+    }
+    mem_mapped = 1;
+    mem_reserved = 1;
+    mem_file = fd;
+    mem_file_off = page;
+    mem_shm = shm;
+    mem_map_flags = MAP_SHARED;
+    mem_map_size = mem_max_heap;
+    mem_use_segment((char *)shm + page, mem_max_heap);
+    mem_nsegs = 0;
+    mem_seg_bytes = 0;
+    mem_brk = mem_start_brk + shm->brk;
+    mem_seg_peak = mem_peak = shm->brk;
+    return 0;
+}
+
+
+
+
+/*
+ * mem_lock, mem_unlock - hold the lock of a shared heap (mem_init_shm)
+ *    around a change to it. mem_lock brings this process's brk up to
+ *    date with the others', and mem_unlock publishes it. If a process
+ *    died holding the lock, the next one gets it anyway, though the
+ *    heap may have been left halfway through a change. Neither does
+ *    anything for a heap that is not shared.
+ */
+void mem_lock(void) {
+    if (mem_shm == NULL)
+	return;
+    if (pthread_mutex_lock(&mem_shm->lock) == EOWNERDEAD)
+	pthread_mutex_consistent(&mem_shm->lock);
+    mem_brk = mem_start_brk + mem_shm->brk;
+}
+
+void mem_unlock(void) {
+    if (mem_shm == NULL)
+	return;
+    mem_shm->brk = mem_brk - mem_start_brk;
+    pthread_mutex_unlock(&mem_shm->lock);
+}
+
+
+
+
+/*
+ * mem_map_block - give a block of at least size bytes a mapping of its
+ *    own, outside the heap segments, so it can later be resized with
+ *    mem_remap_block without copying. The mapping is a whole number of
+ *    pages and counts toward the heap size. A file-backed or shared heap
+ *    has no such blocks, since they would not be in its file. Returns
+ *    the block, or NULL on failure.
+ */
+void *mem_map_block(size_t size) {
+    size_t page = mem_pagesize();
+    mem_block_t *b;
+
+    if (mem_file >= 0 || size > SIZE_MAX - sizeof(mem_block_t) - page) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    size = (size + sizeof(mem_block_t) + page - 1) & ~(page - 1);
+    b = mmap(NULL, size, PROT_READ | PROT_WRITE,
+	     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (b == MAP_FAILED)
+	return NULL;
+    if (mem_huge)
+	madvise(b, size, MADV_HUGEPAGE);
+    b->size = size;
+    b->prev = NULL;
+    if ((b->next = mem_blocks) != NULL)
+	mem_blocks->prev = b;
+    mem_blocks = b;
+    mem_block_bytes += size;
+    if (mem_heapsize() > mem_peak)
+	mem_peak = mem_heapsize();
+    return b + 1;
+}
+
+/*
+ * mem_remap_block - resize a block from mem_map_block to at least size
+ *    bytes with mremap. The kernel moves the pages rather than their
+ *    contents, so this takes the same time whatever the size of the
+ *    block. Returns the block, which may have moved, or NULL if it
+ *    could not be resized, in which case it is unchanged.
+ */
+void *mem_remap_block(void *p, size_t size) {
+    size_t page = mem_pagesize();
+    mem_block_t *b = (mem_block_t *)p - 1;
+    mem_block_t *next = b->next, *prev = b->prev;
+    size_t old_size = b->size;
+
+    if (size > SIZE_MAX - sizeof(mem_block_t) - page) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    size = (size + sizeof(mem_block_t) + page - 1) & ~(page - 1);
+    if (size == old_size)
+	return p;
+    if ((b = mremap(b, old_size, size, MREMAP_MAYMOVE)) == MAP_FAILED)
+	return NULL;
+    if (mem_huge && size > old_size)
+	madvise((char *)b + old_size, size - old_size, MADV_HUGEPAGE);
+
+    /* the neighbours in the list still point at the old address */
+    b->size = size;
+    if (next != NULL)
+	next->prev = b;
+    if (prev != NULL)
+	prev->next = b;
+    else
+	mem_blocks = b;
+    mem_block_bytes += size - old_size;
+    if (mem_heapsize() > mem_peak)
+	mem_peak = mem_heapsize();
+    return b + 1;
+}
+
+/*
+ * mem_unmap_block - give back the mapping of a block from mem_map_block
+ */
+void mem_unmap_block(void *p) {
+    mem_block_t *b = (mem_block_t *)p - 1;
+
+    if (b->next != NULL)
+	b->next->prev = b->prev;
+    if (b->prev != NULL)
+	b->prev->next = b->next;
+    else
+	mem_blocks = b->next;
+    mem_block_bytes -= b->size;
+    munmap(b, b->size);
+}
+
+/*
+ * mem_block_size - the bytes usable in a block from mem_map_block,
+ *    which are at least as many as were asked for
+ */
+size_t mem_block_size(void *p) {
+    return ((mem_block_t *)p - 1)->size - sizeof(mem_block_t);
+}
+
+/*
+ * mem_unmap_all - give back every mapped block
+ */
+static void mem_unmap_all(void) {
+    while (mem_blocks != NULL)
+	mem_unmap_block(mem_blocks + 1);
+}
+
+/*
+ * mem_flush - write the heap pages holding the size bytes at lo back to
+ *    the file behind a file-backed heap, and wait until they are on
+ *    disk. Returns 0, or -1 on error. Other heaps have nothing to flush.
+ */
+int mem_flush(void *lo, size_t size) {
+    size_t page = mem_pagesize();
+    char *start = (char *)((size_t)lo & ~(page - 1));
+
+    if (mem_file < 0 || size == 0)
+	return 0;
+    return msync(start, (char *)lo + size - start, MS_SYNC);
+}
+
+
+
+
+/*
+ * mem_new_segment - start a new heap segment when the current one
+ *    cannot grow any further. The new segment is as large as the heap
+ *    size limit, or min_size bytes if that is more, and need not be
+ *    adjacent to the old one. mem_sbrk extends the new segment from
+ *    then on; the old one keeps its contents and neither grows nor
+ *    shrinks again. Returns 0, or -1 if no more segments can be had.
+ */
+int mem_new_segment(size_t min_size) {
+    size_t size = (min_size > mem_max_heap) ? min_size : mem_max_heap;
+    size_t old_map_size = mem_map_size;
+    char *start = NULL;
+    int i;
+
+    /* a file-backed heap is the one file */
+    if (mem_nsegs == MEM_MAX_SEGMENTS - 1 || mem_file >= 0) {
+	errno = ENOMEM;
+	return -1;
+    }
+    for (i = 0; i < mem_nspares; i++)
+	if ((size_t)(mem_spares[i].max_addr - mem_spares[i].start) >= min_size)
+	    break;
+    if (i == mem_nspares && (start = mem_get_segment(size)) == NULL) {
+	mem_map_size = old_map_size;
+	errno = ENOMEM;
+	return -1;
+    }
+    mem_segs[mem_nsegs].start = mem_start_brk;
+    mem_segs[mem_nsegs].brk = mem_brk;
+    mem_segs[mem_nsegs].max_addr = mem_max_addr;
+    mem_segs[mem_nsegs].commit_brk = mem_commit_brk;
+    mem_segs[mem_nsegs].map_size = old_map_size;
+    mem_segs[mem_nsegs].peak = mem_seg_peak;
+    mem_segs[mem_nsegs].pinned_end = mem_pinned_end;
+    mem_nsegs++;
+    mem_seg_bytes += mem_brk - mem_start_brk;
+    if (start != NULL) {
+	mem_use_segment(start, size);
+	mem_pinned_end = NULL;
+	return 0;
+    }
+
+    /* a segment kept from before the last reset, pages and all */
+    mem_use_segment(mem_spares[i].start,
+		    mem_spares[i].max_addr - mem_spares[i].start);
+    mem_map_size = mem_spares[i].map_size;
+    mem_commit_brk = mem_spares[i].commit_brk;
+    mem_pinned_end = mem_spares[i].pinned_end;
+    mem_spares[i] = mem_spares[--mem_nspares];
+    return 0;
+}
+
+
+
+
+/*
+ * mem_touch - write each page of [start, end) once, keeping its
+ *    contents, and lock the range in RAM if lock is set
+ */
+static int mem_touch(char *start, char *end, int lock) {
+    size_t page = mem_pagesize();
+    volatile char *p;
+
+    for (p = start; p < end; p += page)
+	*p = *p;
+    if (lock && end > start && mlock(start, end - start) < 0)
+	return -1;
+    return 0;
+}
+
+/*
+ * mem_prefault - make the first bytes of the heap resident now, so that
+ *    timed runs over the heap do not pay for page faults. The earlier
+ *    segments are prefaulted up to their brk and the current one takes
+ *    the rest. A reserved heap commits the pages first and never
+ *    decommits them afterwards, and mem_reset_brk keeps the segments
+ *    from then on, so the next run over the same trace finds its later
+ *    segments already resident. If lock is set the pages are locked in
+ *    RAM with mlock. Returns 0, or -1 if the pages could not be
+ *    committed or locked.
+ */
+int mem_prefault(size_t bytes, int lock) {
+    size_t n;
+    char *end;
+    int i;
+
+    for (i = 0; i < mem_nsegs; i++) {
+	n = mem_segs[i].brk - mem_segs[i].start;
+	if (n > bytes)
+	    n = bytes;
+	end = mem_segs[i].start + n;
+	if (mem_touch(mem_segs[i].start, end, lock) < 0)
+	    return -1;
+	if (end > mem_segs[i].pinned_end)
+	    mem_segs[i].pinned_end = end;
+	bytes -= n;
+    }
+
+    if (bytes > (size_t)(mem_max_addr - mem_start_brk))
+	bytes = mem_max_addr - mem_start_brk;
+    end = mem_start_brk + bytes;
+    if (mem_reserved && mem_commit(end) < 0)
+	return -1;
+    if (end > mem_pinned_end || mem_pinned_end > mem_max_addr)
+	mem_pinned_end = end;
+    mem_keep_segs = 1;
+    return mem_touch(mem_start_brk, end, lock);
+}
+
+
+
+
+/*
+ * mem_write_all, mem_read_all - write or read n bytes at offset off of
+ *    fd, retrying short transfers. Return 0, or -1 on error or EOF.
+ */
+static int mem_write_all(int fd, const void *buf, size_t n, off_t off) {
+    ssize_t done;
+
+    while (n > 0) {
+	if ((done = pwrite(fd, buf, n, off)) <= 0)
+	    return -1;
+	buf = (const char *)buf + done;
+	n -= done;
+	off += done;
+    }
+    return 0;
+}
+
+static int mem_read_all(int fd, void *buf, size_t n, off_t off) {
+    ssize_t done;
+
+    while (n > 0) {
+	if ((done = pread(fd, buf, n, off)) <= 0)
+	    return -1;
+	buf = (char *)buf + done;
+	n -= done;
+	off += done;
+    }
+    return 0;
+}
+
+/*
+ * mem_save - write an image of the heap to fd at its current offset:
+ *    the number of segments and each one's start and size, then the
+ *    contents of each segment, oldest first, starting on a page
+ *    boundary so mem_load can map them. Mapped blocks are not part of
+ *    the image, so a heap with any cannot be saved. Returns 0, or -1 on
+ *    error.
+ */
+int mem_save(int fd) {
+    size_t page = mem_pagesize();
+    int n = mem_nsegs + 1, i;
+    off_t off = lseek(fd, 0, SEEK_CUR);
+
+    if (mem_blocks != NULL) {
+	errno = EINVAL;
+	return -1;
+    }
+    for (i = 0; i < n; i++) {
+	mem_images[i].start = (i < mem_nsegs) ? mem_segs[i].start : mem_start_brk;
+	mem_images[i].size = (i < mem_nsegs) ?
+	    (size_t)(mem_segs[i].brk - mem_segs[i].start) :
+	    (size_t)(mem_brk - mem_start_brk);
+    }
+    if (off < 0 || mem_write_all(fd, &n, sizeof(n), off) < 0 ||
+	mem_write_all(fd, mem_images, n * sizeof(mem_image_t),
+		      off + sizeof(n)) < 0)
+	return -1;
+    off += sizeof(n) + n * sizeof(mem_image_t);
+    for (i = 0; i < n; i++) {
+	off = (off + page - 1) & ~(off_t)(page - 1);
+	if (mem_write_all(fd, mem_images[i].start, mem_images[i].size, off) < 0)
+	    return -1;
+	off += mem_images[i].size;
+    }
+    return (lseek(fd, off, SEEK_SET) < 0) ? -1 : 0;
+}
+
+/*
+ * mem_load - replace the heap with an image written by mem_save, read
+ *    from fd at its current offset. Each saved segment goes into a
+ *    segment of this heap, the last one becoming current. In a mapped
+ *    heap the images are mapped from the file copy-on-write, so pages
+ *    are read only when first touched, until mem_reset_brk puts fresh
+ *    anonymous memory back in their place; otherwise they are read in.
+ *    Returns 1 if any segment landed at a different address than it
+ *    was saved from (see mem_relocate), 0 if none did, or -1 on error,
+ *    which leaves the heap empty.
+ */
+int mem_load(int fd) {
+    size_t page = mem_pagesize();
+    size_t size, span;
+    int n, i, moved = 0;
+    off_t off = lseek(fd, 0, SEEK_CUR);
+
+    mem_nimages = 0;
+    if (off < 0 || mem_read_all(fd, &n, sizeof(n), off) < 0 ||
+	n < 1 || n > MEM_MAX_SEGMENTS ||
+	mem_read_all(fd, mem_images, n * sizeof(mem_image_t),
+		     off + sizeof(n)) < 0)
+	return -1;
+    off += sizeof(n) + n * sizeof(mem_image_t);
+
+    mem_reset_brk();
+    for (i = 0; i < n; i++) {
+	size = mem_images[i].size;
+	if ((i > 0 && mem_new_segment(size) < 0) ||
+	    size > (size_t)(mem_max_addr - mem_start_brk))
+	    goto fail;
+	off = (off + page - 1) & ~(off_t)(page - 1);
+	span = (size + page - 1) & ~(page - 1);
+	/* huge pages cannot be backed by an ordinary file, and a
+	   file-backed heap must stay in its own file */
+	if (!mem_mapped || mem_huge || mem_file >= 0 || span == 0 ||
+	    span > (size_t)(mem_max_addr - mem_start_brk) ||
+	    mmap(mem_start_brk, span, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_FIXED, fd, off) == MAP_FAILED) {
+	    if ((mem_reserved && mem_commit(mem_start_brk + size) < 0) ||
+		mem_read_all(fd, mem_start_brk, size, off) < 0)
+		goto fail;
+	}
+	else {
+	    mem_filemap_start[mem_nfilemaps] = mem_start_brk;
+	    mem_filemap_span[mem_nfilemaps++] = span;
+	    if (mem_reserved && mem_commit_brk < mem_start_brk + span)
+		mem_commit_brk = mem_start_brk + span;
+	}
+	mem_brk = mem_start_brk + size;
+	mem_seg_peak = size;
+	mem_peak = mem_seg_bytes + size;
+	mem_loaded[i] = mem_start_brk;
+	moved |= mem_start_brk != mem_images[i].start;
+	off += size;
+    }
+    mem_nimages = n;
+    return (lseek(fd, off, SEEK_SET) < 0) ? -1 : moved;
+
+ fail:
+    mem_reset_brk();
+    return -1;
+}
+
+/*
+ * mem_relocate - map an address in the heap image last loaded by
+ *    mem_load to where that byte is now. Addresses outside the image
+ *    (such as NULL) are returned unchanged.
+ */
+void *mem_relocate(void *old) {
+    char *p = (char *)old;
+    int i;
+
+    for (i = 0; i < mem_nimages; i++)
+	if (p >= mem_images[i].start &&
+	    p <= mem_images[i].start + mem_images[i].size)
+	    return mem_loaded[i] + (p - mem_images[i].start);
+    return old;
 }
 
 
@@ -42,14 +846,159 @@ void mem_init(void) {
  * mem_deinit - free the storage used by the memory system model
  */
 void mem_deinit(void) {
-    free(mem_start_brk);
+    int i;
+
+    mem_unmap_all();
+    mem_put_segment(mem_start_brk - mem_file_off, mem_map_size + mem_file_off);
+    for (i = 0; i < mem_nsegs; i++)
+	mem_put_segment(mem_segs[i].start, mem_segs[i].map_size);
+    for (i = 0; i < mem_nspares; i++)
+	mem_put_segment(mem_spares[i].start, mem_spares[i].map_size);
+    mem_nsegs = 0;
+    mem_nspares = 0;
+    mem_nfilemaps = 0;
+    mem_keep_segs = 0;
+    mem_pinned_end = NULL;
+    if (mem_file >= 0) {
+	close(mem_file);
+	mem_file = -1;
+	mem_file_off = 0;
+	mem_shm = NULL;
+    }
 }
 
 /*
- * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ * mem_reset_brk - reset the simulated brk pointer to make an empty heap,
+ *    giving back every segment but the first and every mapped block.
+ *    Once the heap has been prefaulted the later segments are kept
+ *    instead, for mem_new_segment to hand out again.
  */
 void mem_reset_brk() {
+    mem_seg_t cur, *seg;
+    int i;
+
+    mem_unmap_all();
+    mem_drop_filemaps();
+    if (mem_nsegs > 0) {
+	/* the current segment goes back with the others after the first */
+	cur.start = mem_start_brk;
+	cur.max_addr = mem_max_addr;
+	cur.commit_brk = mem_commit_brk;
+	cur.map_size = mem_map_size;
+	cur.pinned_end = mem_pinned_end;
+	for (i = 1; i <= mem_nsegs; i++) {
+	    seg = (i < mem_nsegs) ? &mem_segs[i] : &cur;
+	    if (mem_keep_segs && mem_nspares < MEM_MAX_SEGMENTS - 1)
+		mem_spares[mem_nspares++] = *seg;
+	    else
+		mem_put_segment(seg->start, seg->map_size);
+	}
+	mem_map_size = mem_segs[0].map_size;
+	mem_start_brk = mem_segs[0].start;
+	mem_max_addr = mem_segs[0].max_addr;
+	mem_commit_brk = mem_segs[0].commit_brk;
+	mem_pinned_end = mem_segs[0].pinned_end;
+	mem_nsegs = 0;
+	mem_seg_bytes = 0;
+    }
     mem_brk = mem_start_brk;
+    mem_peak = 0;
+    mem_seg_peak = 0;
+    if (mem_reserved)
+	mem_decommit(mem_start_brk);
+}
+
+/*
+ * mem_drop_filemaps - map fresh anonymous memory over the heap pages
+ *    mem_load mapped from an image file. Later runs then get ordinary
+ *    pages rather than copy-on-write ones of the file, and the file's
+ *    disk space goes once it has been unlinked.
+ */
+static void mem_drop_filemaps(void) {
+    int i;
+
+    /* if this fails the file pages stay, which is slower but still works */
+    for (i = 0; i < mem_nfilemaps; i++)
+	mmap(mem_filemap_start[i], mem_filemap_span[i], PROT_READ | PROT_WRITE,
+	     mem_map_flags | MAP_FIXED, -1, 0);
+    mem_nfilemaps = 0;
+}
+
+/*
+ * mem_page_up - round addr up to a page boundary, or a huge page
+ *    boundary if the heap is backed by huge pages
+ */
+static char *mem_page_up(char *addr) {
+    size_t page = mem_huge ? MEM_HUGE_PAGE : mem_pagesize();
+    return (char *)(((size_t)addr + page - 1) & ~(page - 1));
+}
+
+/*
+ * mem_commit - make the reserved pages below addr usable, committing
+ *    at least MEM_COMMIT_UNIT bytes at a time to keep the number of
+ *    mprotect calls down while the heap grows in small steps
+ */
+static int mem_commit(char *addr) {
+    char *end = mem_page_up(addr);
+    struct stat st;
+
+    if (end <= mem_commit_brk)
+	return 0;
+    if (end < mem_commit_brk + MEM_COMMIT_UNIT)
+	end = mem_commit_brk + MEM_COMMIT_UNIT;
+    if (end > mem_start_brk + mem_map_size)
+	end = mem_start_brk + mem_map_size;
+    if (end <= mem_commit_brk)
+	return 0;
+    if (mem_file >= 0) {
+	/* another process sharing the file may have grown it further */
+	if (fstat(mem_file, &st) < 0 ||
+	    ((size_t)st.st_size < mem_file_off + (end - mem_start_brk) &&
+	     ftruncate(mem_file, mem_file_off + (end - mem_start_brk)) < 0))
+	    return -1;
+    }
+    else if (mprotect(mem_commit_brk, end - mem_commit_brk,
+		      PROT_READ | PROT_WRITE) < 0)
+	return -1;
+    mem_commit_brk = end;
+    return 0;
+}
+
+/*
+ * mem_decommit - give back the committed pages from addr up. Mapping
+ *    fresh PROT_NONE pages over them frees the memory and the commit
+ *    charge in one call; the range stays reserved.
+ */
+static void mem_decommit(char *addr) {
+    char *start;
+
+    /* prefaulted pages stay committed */
+    if (mem_pinned_end > addr && mem_pinned_end <= mem_max_addr &&
+	addr >= mem_start_brk)
+	addr = mem_pinned_end;
+    start = mem_page_up(addr);
+
+    if (start >= mem_commit_brk)
+	return;
+    if (mem_shm != NULL)
+	return;  /* a shared heap never shrinks (mem_init_shm) */
+    if (mem_file >= 0) {
+	if (ftruncate(mem_file, mem_file_off + (start - mem_start_brk)) < 0) {
+	    fprintf(stderr, "mem_decommit: ftruncate error\n");
+	    exit(1);
+	}
+	mem_commit_brk = start;
+	return;
+    }
+    if (mmap(start, mem_commit_brk - start, PROT_NONE,
+	     mem_map_flags | MAP_FIXED, -1, 0) == MAP_FAILED) {
+	fprintf(stderr, "mem_decommit: mmap error\n");
+	exit(1);
+    }
+    /* the new pages do not inherit the old ones' advice */
+    if (mem_huge && !(mem_map_flags & MAP_HUGETLB))
+	madvise(start, mem_commit_brk - start, MADV_HUGEPAGE);
+    mem_commit_brk = start;
 }
 
 
@@ -57,18 +1006,35 @@ void mem_reset_brk() {
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ *    by incr bytes and returns the start address of the new area, or
+ *    shrinks it if incr is negative, returning the old brk.
  */
-void *mem_sbrk(int incr)  {
+void *mem_sbrk(intptr_t incr)  {
     char *old_brk = mem_brk;
 
-    if ((incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
+    if (incr < 0) {
+	if (-incr > mem_brk - mem_start_brk) {
+	    errno = EINVAL;
+	    fprintf(stderr, "ERROR: mem_sbrk failed. Heap cannot shrink that far\n");
+	    return (void *)-1;
+	}
+	mem_brk += incr;
+	if (mem_reserved)
+	    mem_decommit(mem_brk);
+	return (void *)old_brk;
+    }
+
+    /* not an error for the caller, which can start a new segment */
+    if ((incr > mem_max_addr - mem_brk) ||
+	(mem_reserved && mem_commit(mem_brk + incr) < 0)) {
 	errno = ENOMEM;
-	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
 	return (void *)-1;
     }
     mem_brk += incr;
+    if ((size_t)(mem_brk - mem_start_brk) > mem_seg_peak)
+	mem_seg_peak = mem_brk - mem_start_brk;
+    if (mem_heapsize() > mem_peak)
+	mem_peak = mem_heapsize();
     return (void *)old_brk;
 }
 
@@ -76,17 +1042,18 @@ void *mem_sbrk(int incr)  {
 
 
 /*
- * mem_heap_lo - return address of the first heap byte
+ * mem_heap_lo - return address of the first heap byte of the first
+ *    segment
  */
 void *mem_heap_lo() {
-    return (void *)mem_start_brk;
+    return (void *)(mem_nsegs > 0 ? mem_segs[0].start : mem_start_brk);
 }
 
 
 
 
 /* 
- * mem_heap_hi - return address of last heap byte
+ * mem_heap_hi - return address of last heap byte of the current segment
  */
 void *mem_heap_hi() {
     return (void *)(mem_brk - 1);
@@ -96,10 +1063,123 @@ void *mem_heap_hi() {
 
 
 /*
- * mem_heapsize() - returns the heap size in bytes
+ * mem_in_heap - returns 1 if the size bytes at lo lie within the heap
+ *    of one segment, 0 otherwise
+ */
+int mem_in_heap(void *lo, size_t size) {
+    char *p = (char *)lo;
+    int i;
+
+    mem_block_t *b;
+
+    if (p >= mem_start_brk && p <= mem_brk && size <= (size_t)(mem_brk - p))
+	return 1;
+    for (i = 0; i < mem_nsegs; i++)
+	if (p >= mem_segs[i].start && p <= mem_segs[i].brk &&
+	    size <= (size_t)(mem_segs[i].brk - p))
+	    return 1;
+    for (b = mem_blocks; b != NULL; b = b->next)
+	if (p >= (char *)(b + 1) && p <= (char *)b + b->size &&
+	    size <= (size_t)((char *)b + b->size - p))
+	    return 1;
+    return 0;
+}
+
+
+
+
+/*
+ * mem_heapsize() - returns the heap size in bytes, over all segments
+ *    and mapped blocks
  */
 size_t mem_heapsize() {
-    return (size_t)(mem_brk - mem_start_brk);
+    return mem_seg_bytes + (size_t)(mem_brk - mem_start_brk) + mem_block_bytes;
+}
+
+
+
+
+/*
+ * mem_peak_heapsize() - returns the largest heap size in bytes since
+ *    the heap was last reset, which the brk no longer records once the
+ *    heap can shrink
+ */
+size_t mem_peak_heapsize() {
+    return mem_peak;
+}
+
+
+
+
+/*
+ * mem_hugepage_bytes() - returns how many bytes of the heap mapping are
+ *    currently backed by huge pages, from /proc/self/smaps, or 0 if
+ *    that cannot be read. Calls stdio, so not for use inside malloc.
+ */
+size_t mem_hugepage_bytes() {
+    FILE *fp = fopen("/proc/self/smaps", "r");
+    char line[256];
+    unsigned long lo, hi;
+    size_t kb, total = 0;
+    int ours = 0, i;
+
+    if (fp == NULL)
+	return 0;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+	if (sscanf(line, "%lx-%lx ", &lo, &hi) == 2) {
+	    ours = (char *)lo < mem_max_addr && (char *)hi > mem_start_brk;
+	    for (i = 0; i < mem_nsegs; i++)
+		ours |= (char *)lo < mem_segs[i].max_addr &&
+			(char *)hi > mem_segs[i].start;
+	}
+	else if (ours && (sscanf(line, "AnonHugePages: %zu kB", &kb) == 1 ||
+			  sscanf(line, "Private_Hugetlb: %zu kB", &kb) == 1))
+	    total += kb * 1024;
+    }
+    fclose(fp);
+    return total;
+}
+
+
+
+
+/*
+ * mem_resident - returns how many bytes of the pages from lo to hi are
+ *    resident in physical memory, per mincore
+ */
+static size_t mem_resident(char *lo, char *hi) {
+    unsigned char vec[4096];
+    size_t page = mem_pagesize();
+    size_t n, i, total = 0;
+
+    lo = (char *)((size_t)lo & ~(page - 1));
+    while (lo < hi) {
+	n = (hi - lo + page - 1) / page;
+	if (n > sizeof(vec))
+	    n = sizeof(vec);
+	if (mincore(lo, n * page, vec) < 0)
+	    return 0;
+	for (i = 0; i < n; i++)
+	    total += vec[i] & 1;
+	lo += n * page;
+    }
+    return total * page;
+}
+
+/*
+ * mem_resident_bytes() - returns how many bytes of the heap, up to the
+ *    peak size of each segment since the last reset, are resident in
+ *    physical memory. Pages the allocator gave back with madvise, or
+ *    that were decommitted or never touched, do not count.
+ */
+size_t mem_resident_bytes() {
+    size_t total = mem_resident(mem_start_brk, mem_start_brk + mem_seg_peak);
+    int i;
+
+    for (i = 0; i < mem_nsegs; i++)
+	total += mem_resident(mem_segs[i].start,
+			      mem_segs[i].start + mem_segs[i].peak);
+    return total;
 }
 
 
@@ -2,14 +2,41 @@
 #define MEMLIB_H
 
 #include <unistd.h>
+#include <stdint.h>
 
+/* most segments the heap can be made of (see mem_new_segment) */
+#define MEM_MAX_SEGMENTS 64
+
+void mem_set_max_heap(size_t bytes);
+int mem_parse_size(const char *s, size_t *bytes);
+void mem_set_hugepages(int on);
 void mem_init(void);               
+void mem_init_vm(void);
+void mem_init_reserve(void);
+int mem_init_file(const char *path);
+int mem_flush(void *lo, size_t size);
+int mem_init_shm(const char *name, int create);
+void mem_lock(void);
+void mem_unlock(void);
+int mem_new_segment(size_t min_size);
+void *mem_map_block(size_t size);
+void *mem_remap_block(void *p, size_t size);
+void mem_unmap_block(void *p);
+size_t mem_block_size(void *p);
+int mem_prefault(size_t bytes, int lock);
+int mem_save(int fd);
+int mem_load(int fd);
+void *mem_relocate(void *old);
 void mem_deinit(void);
-void *mem_sbrk(int incr);
+void *mem_sbrk(intptr_t incr);
 void mem_reset_brk(void); 
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
+int mem_in_heap(void *lo, size_t size);
 size_t mem_heapsize(void);
+size_t mem_peak_heapsize(void);
+size_t mem_hugepage_bytes(void);
+size_t mem_resident_bytes(void);
 size_t mem_pagesize(void);
 
 #endif
@@ -1,20 +1,41 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
 #include <assert.h>
 #include <unistd.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 
 #include "./mm.h"
 #include "./memlib.h"
+#include "./mm_classes.h"
 #include "./mminline.h"
 
 
+// largest request we accept; rounding and tags cannot overflow below this
+#define MAX_REQUEST ((size_t)PTRDIFF_MAX / 2)
+
+// a free block at the end of the heap at least this big is given back to memlib
+#define TRIM_THRESHOLD (128 * 1024)
+
+// the bit in a block's header that marks it as mapped (see map_block)
+#define MAPPED 2
+
 // rounds up to the nearest multiple of WORD_SIZE
 static inline size_t align(size_t size) {
   return (((size) + (WORD_SIZE - 1)) & ~(WORD_SIZE - 1));
 }
 
 int mm_check_heap(void);
+block_t *mm_extend_heap(size_t size);
+void trim_heap(block_t *last);
+void release_pages(block_t *b, char *lo, char *hi);
+int new_segment(size_t size);
+static void mark_dirty(void);
+static block_t *map_block(size_t size);
+static void *remap_block(block_t *b, size_t size);
 
 
 /*
@@ -34,43 +55,129 @@ block_t *prologue;
 block_t *epilogue;
 block_t *first_block;
 int counter = 0;
+static size_t extend_min = 640;  // smallest heap extension; see mm_init_hint.
+static size_t release_threshold = 0;  // off by default; see mm_set_release_threshold.
+static size_t mmap_threshold = 0;  // off by default; see mm_set_mmap_threshold.
+
+// prologues of the heap segments in the order memlib handed them out (see new_segment).
+// the last one is the segment the heap grows in, which epilogue ends.
+static block_t *segments[MEM_MAX_SEGMENTS];
+static int num_segments = 0;
+
+/*
+the root of the heap, at mem_heap_lo() ahead of the first prologue. mm_flush leaves in it
+everything mm keeps outside the blocks, as offsets from the root itself, so that a heap in a
+file (mem_init_file) can be reopened with mm_open wherever the file is mapped next. it is
+padded to 16 bytes so the blocks after it keep the alignment they had without it.
+*/
+typedef struct {
+  size_t magic;
+  size_t state;                   // ROOT_CLEAN from mm_flush until the heap next changes
+  size_t num_classes;
+  size_t end;                     // offset of the end of the heap, past the epilogue
+  size_t extend_min;
+  size_t flists[MM_NUM_CLASSES];  // offset of each free list's head, 0 if it is empty
+} root_t;
+
+#define ROOT_SIZE ((sizeof(root_t) + 15) & ~(size_t) 15)
+#define ROOT_MAGIC ((size_t)0x6d6d726f6f743031)  // "mmroot01"
+#define ROOT_CLEAN 1
+#define ROOT_DIRTY 2
+
+static int flushed = 0;  // has the heap not changed since mm_flush?
 
 int mm_init(void) {
+  return mm_init_hint(0);
+}
+
+/*
+mm_init with the expected peak of live payload bytes, e.g. the suggested heap size in a
+trace header. the heap is extended once by that much up front, so warm-up does not go
+through many small mm_extend_heap calls, and later extensions are at least 1/16 of it.
+a hint of 0 is the same as mm_init.
+*/
+int mm_init_hint(size_t expected_peak) {
   void *start;
-  start = mem_sbrk(2 * TAGS_SIZE);  // 16 + 16 bytes for pro and epilogue,
+  start = mem_sbrk(ROOT_SIZE + 2 * TAGS_SIZE);  // the root, then 16 + 16 bytes for pro and epilogue,
   if (start == (void *) -1) {
     fprintf(stderr, "%s\n", "My Error: Ran out of memory");
     return 1;
   }
 
   assert(start == mem_heap_lo());
-  prologue = (block_t *) start;
+  heap_base = start;
+  memset(start, 0, ROOT_SIZE);
+  ((root_t *) start)->magic = ROOT_MAGIC;
+  ((root_t *) start)->num_classes = MM_NUM_CLASSES;
+  mark_dirty();
+  prologue = (block_t *) (heap_base + ROOT_SIZE);
   block_set_size_and_allocated (prologue, TAGS_SIZE, 1);
 
   epilogue = block_next(prologue);
   block_set_size_and_allocated (epilogue, TAGS_SIZE, 1);
-  flist_first = NULL;
+  segments[0] = prologue;
+  num_segments = 1;
+  for (int i = 0; i < MM_NUM_CLASSES; i++) {
+    flists[i] = NULL;
+  }
+
+  extend_min = 640;
+  if (expected_peak > 0) {
+    if (align(expected_peak / 16) > extend_min) {
+      extend_min = align(expected_peak / 16);
+    }
+    if (mm_extend_heap(expected_peak) == NULL) {
+      return 1;
+    }
+  }
   return 0;
 }
 /*
-returns a pointer to the first free block in the free list that has a paylod of at least size.
+free blocks that coalesce into at least bytes have the whole pages inside them given
+back to the kernel with madvise(MADV_DONTNEED), so a large hole in the middle of the
+heap does not stay resident. the block keeps its tags and free list links, and its pages
+fault back in (zeroed) when it is reused. 0, the default, turns this off: the page faults
+on reuse cost more throughput than most traces can spare.
+*/
+void mm_set_release_threshold(size_t bytes) {
+  release_threshold = bytes;
+}
+
+/*
+requests of at least bytes get a mapping of their own from memlib instead of a block in
+the heap (see map_block), and realloc resizes them with mremap, which moves page table
+entries instead of copying the payload: doubling a 1 GB block takes a few ms instead of
+the tens of ms a copy does (mdriver -Z -v). a heap realloc that grows past bytes moves the block into a mapping, and
+one that shrinks below it moves the block back. 0, the default, turns this off. memlib
+has no mappings for a heap kept in a file or shared memory, so there every request stays
+in the heap.
+*/
+void mm_set_mmap_threshold(size_t bytes) {
+  mmap_threshold = bytes;
+}
+
+/*
+returns a pointer to the first free block in the free lists that has a paylod of at least size.
 we are subtracting 16 from the block size instead of 32 because there is actually 16 bytes in there
 that can be used as payload.
+the search starts at the list of the class that size falls in and moves up to larger classes.
 returns NULL if nothing fits.
 */
 block_t *first_fit(size_t size) {
-  block_t *curr_block = flist_first;
-  if (curr_block == NULL) {  // the free list has not yet been initalized, so return null.
-    return NULL;
-  }
-  do {
-    assert(!block_allocated(curr_block));
-    size_t payload_size = block_size(curr_block) - 16;
-    if (payload_size >= size) { // if the payload is at least size big, return that space.
-      return curr_block;
+  for (int i = size_class(size + TAGS_SIZE); i < MM_NUM_CLASSES; i++) {
+    block_t *curr_block = flists[i];
+    if (curr_block == NULL) {  // nothing free in this class, try the next one.
+      continue;
     }
-    curr_block = block_next_free(curr_block); // only goes for the next free block.
-  } while (curr_block != flist_first);
+    do {
+      assert(!block_allocated(curr_block));
+      size_t payload_size = block_size(curr_block) - 16;
+      if (payload_size >= size) { // if the payload is at least size big, return that space.
+        return curr_block;
+      }
+      curr_block = block_next_free(curr_block); // only goes for the next free block.
+    } while (curr_block != flists[i]);
+  }
   return NULL;
 }
 
@@ -78,14 +185,20 @@ block_t *first_fit(size_t size) {
 
 coalesces the input block_t curr_block with blocks around it.
 returns the coaesced block.
+merged blocks are pulled from the free lists before their size changes and the result
+is inserted again, since the size decides which class list a block is on.
 
 Case 1: prev and next are allocated: Do nothing.
 Case 2: prev allocated, next is free. merge current with next.
 Case 3: prev free, next allocated. merge current with prev.
 Case 4: both surrounding are free, merge with both.
 
+if the result is at least release_threshold bytes, the parts whose pages may still be
+resident are released: curr_block unless curr_released says its pages were never used or
+already given back (fresh heap, or a piece split off a free block), and any neighbor that
+was too small to have been released when it was formed.
 */
-block_t *coalesce (block_t * curr_block) { //TODO: error check all calls to inlines
+block_t *coalesce (block_t * curr_block, int curr_released) { //TODO: error check all calls to inlines
 
   int current_free = !block_allocated(curr_block);
   assert (current_free);
@@ -96,33 +209,54 @@ block_t *coalesce (block_t * curr_block) { //TODO: error check all calls to inli
   size_t next_size = block_next_size(curr_block);
   block_t *prev = block_prev(curr_block);
   block_t *next = block_next(curr_block);
+  block_t *result = NULL;
   // Case 1 prev and next are allocated: Do nothing.
   if (!prev_free && !next_free) {
     //printf("%s\n", "Case 1");
     //mm_check_heap();
-    return curr_block;
+    result = curr_block;
   }
   // Case 2: prev allocated, next is free. merge current with next.
-  if (!prev_free && next_free) {
+  else if (!prev_free && next_free) {
     pull_free_block(next);
+    pull_free_block(curr_block);
     block_set_size(curr_block, current_size + next_size);
     assert(!block_allocated(curr_block));
-    return curr_block;
+    insert_free_block(curr_block);
+    result = curr_block;
   }
   // Case 3: prev free, next allocated. merge current with prev.
-  if (prev_free && !next_free) {
+  else if (prev_free && !next_free) {
     pull_free_block(curr_block);
+    pull_free_block(prev);
     block_set_size(prev, prev_size + current_size); // increase size of previous block.
     assert(!block_allocated(prev));
-    return prev;
+    insert_free_block(prev);
+    result = prev;
   }
   // Case 4: both surrounding are free, merge with both.
-  if (prev_free && next_free) {
-    pull_free_block(next); // pull out the current and next blocks
+  else if (prev_free && next_free) {
+    pull_free_block(next); // pull out all three blocks
     pull_free_block(curr_block);
+    pull_free_block(prev);
     block_set_size(prev, prev_size + current_size + next_size); // increase size of previous block.
     assert(!block_allocated(prev));
-    return prev;
+    insert_free_block(prev);
+    result = prev;
+  }
+  if (result != NULL) {
+    if (release_threshold > 0 && block_size(result) >= release_threshold) {
+      if (prev_free && prev_size < release_threshold) {
+        release_pages(result, (char *) prev, (char *) curr_block);
+      }
+      if (!curr_released) {
+        release_pages(result, (char *) curr_block, (char *) curr_block + current_size);
+      }
+      if (next_free && next_size < release_threshold) {
+        release_pages(result, (char *) next, (char *) next + next_size);
+      }
+    }
+    return result;
   }
   fprintf(stderr, "%s\n", "coalescing failed.");
   return NULL; // if none of these, return NULL.
@@ -143,13 +277,16 @@ block_t *mm_extend_heap (size_t size) {
     fprintf(stderr, "%s\n", "must extend heap by at least size of a block.");
   }
 
-  if(size < 640) {
-    size = 640;
+  if(size < extend_min) {
+    size = extend_min;
   }
 
   if (mem_sbrk(size + TAGS_SIZE) == (void *) -1) {
-    fprintf(stderr, "%s\n", "Ran out of memory");
-    return NULL;
+    // the current segment is full, so continue in a new one.
+    if (new_segment(size + TAGS_SIZE) != 0 || mem_sbrk(size + TAGS_SIZE) == (void *) -1) {
+      fprintf(stderr, "%s\n", "Ran out of memory");
+      return NULL;
+    }
   }
   block_t *new_block;
   new_block = epilogue;
@@ -157,7 +294,81 @@ block_t *mm_extend_heap (size_t size) {
   epilogue = block_next(new_block);
   block_set_size_and_allocated (epilogue, TAGS_SIZE, 1);  // initializing new epilogue
   insert_free_block(new_block);  // inserting new block.
-  return coalesce (new_block); // insures that heap is still coalesced. returns ptr to last free block.
+  return coalesce (new_block, 1); // insures that heap is still coalesced. returns ptr to last free block.
+}
+
+/*
+starts a new heap segment from memlib, with room for a block of size bytes, when the
+current one cannot be extended. the new segment gets a prologue and epilogue of its own,
+so each segment is a separate boundary-tag chain and coalescing never crosses from one
+to another, while the free lists are shared by all of them. epilogue moves to the new
+segment; the old one keeps its epilogue and never grows again.
+returns 0 on success, 1 on failure.
+*/
+int new_segment(size_t size) {
+  void *start;
+  block_t *last = block_prev(epilogue);
+  if (num_segments == MEM_MAX_SEGMENTS || mem_new_segment(size + 2 * TAGS_SIZE) != 0) {
+    return 1;
+  }
+  // the free block at the end of the old segment can no longer be trimmed, so give its
+  // pages back instead.
+  if (!block_allocated(last)) {
+    release_pages(last, (char *) last, (char *) epilogue);
+  }
+  if ((start = mem_sbrk(2 * TAGS_SIZE)) == (void *) -1) {
+    return 1;
+  }
+  prologue = (block_t *) start;
+  block_set_size_and_allocated (prologue, TAGS_SIZE, 1);
+  epilogue = block_next(prologue);
+  block_set_size_and_allocated (epilogue, TAGS_SIZE, 1);
+  segments[num_segments++] = prologue;
+  return 0;
+}
+
+/*
+shrinks the heap when the free block at its end, last, is at least TRIM_THRESHOLD bytes.
+last keeps extend_min bytes, so a program that frees and allocates around the threshold
+does not move the brk back and forth; the rest goes back to memlib with a negative
+mem_sbrk, and the epilogue moves down to the new end of the heap.
+*/
+void trim_heap(block_t *last) {
+  size_t size = block_size(last);
+  size_t keep = align(extend_min + TAGS_SIZE);
+  if (size < TRIM_THRESHOLD || size - keep < TRIM_THRESHOLD / 2) {
+    return;
+  }
+  pull_free_block(last);
+  if (mem_sbrk(-(intptr_t)(size - keep)) == (void *) -1) {
+    insert_free_block(last);
+    return;
+  }
+  block_set_size_and_allocated(last, keep, 0);
+  epilogue = block_next(last);
+  block_set_size_and_allocated(epilogue, TAGS_SIZE, 1);
+  insert_free_block(last);
+}
+
+/*
+gives back the whole pages between lo and hi inside the free block b, leaving alone the
+pages holding b's header, free list links and end tag. the range stays mapped.
+*/
+void release_pages(block_t *b, char *lo, char *hi) {
+  size_t page = mem_pagesize();
+  char *start = (char *) &b->payload[2];  // past the header and the two links
+  char *end = (char *) block_end_tag(b);
+  if (lo < start) {
+    lo = start;
+  }
+  if (hi > end) {
+    hi = end;
+  }
+  lo = (char *) (((uintptr_t) lo + page - 1) & ~(uintptr_t) (page - 1));
+  hi = (char *) ((uintptr_t) hi & ~(uintptr_t) (page - 1));
+  if (lo < hi) {
+    madvise(lo, hi - lo, MADV_DONTNEED);
+  }
 }
 
 /*
@@ -172,10 +383,12 @@ set it to allocated, because its about to get returned.
 next, it will call next_block on this newly created block. this block will be our new block, and will be set to size
 
 block_size(original_block) - block_size(newly_created_block). it will be set to free, and will call coalesce on it.
+leftover_released says whether the leftover's pages may already have been given back (see coalesce): true when it is
+cut from a free block, false when it still holds payload that realloc has just moved.
 
 */
 // note that size_of_first_block indicates the entire size of block with tags included.
-int split_block(block_t* original_block, size_t size_of_first_block) {
+int split_block(block_t* original_block, size_t size_of_first_block, int leftover_released) {
   size_t original_block_size = block_size(original_block);
   size_t leftover_size = original_block_size - size_of_first_block;
   if (leftover_size < original_block_size / 2 || leftover_size < 32) {  // because a TA said to do this.
@@ -186,7 +399,7 @@ int split_block(block_t* original_block, size_t size_of_first_block) {
   block_t *leftover_block = block_next(first_block);
   block_set_size_and_allocated(leftover_block, leftover_size, 0);  // size is anything left over.
   insert_free_block(leftover_block);
-  coalesce(leftover_block);
+  coalesce(leftover_block, leftover_released);
   return 0;
 }
 
@@ -214,23 +427,33 @@ Order of operations:
 void *mm_malloc(size_t size) {
   block_t *to_return = NULL;
   // (1) Ignore spurious requests
-  if (size == 0) {
+  if (size == 0 || size > MAX_REQUEST) {
     return to_return;
   }
+  if (flushed) {
+    mark_dirty();
+  }
   // (2) Adjust block size to include overhead and alignment requests
   if (size <= 32) {
     size = 32;  //TODO: this is not very compact. how to change?
   } else {
     size = align(size);  // making sure it's aligned.
   }
+  if (mmap_threshold > 0 && size >= mmap_threshold &&
+      (to_return = map_block(size)) != NULL) {
+    return to_return->payload;
+  }
   // (3) Search the free list for a fit
   to_return = first_fit(size); // to_return has a payload of at least size.
   /*  NO FIT FOUND */
   if (to_return == NULL) {
     to_return = mm_extend_heap(size);
+    if (to_return == NULL) {  // out of memory
+      return NULL;
+    }
   }
   pull_free_block(to_return);
-  split_block(to_return, size + TAGS_SIZE);  // keep in mind that split_block's second argument asks for FULL SIZE of desired block.
+  split_block(to_return, size + TAGS_SIZE, 1);  // keep in mind that split_block's second argument asks for FULL SIZE of desired block.
   block_set_allocated(to_return, 1);
   return to_return->payload;
 }
@@ -252,11 +475,21 @@ void mm_free(void *ptr) {
     printf("%s\n", "trying to free a null.");
     return;
   }
+  if (flushed) {
+    mark_dirty();
+  }
 
   block_t *block_to_free = payload_to_block(ptr);
+  if (block_mapped(block_to_free)) {
+    mem_unmap_block(block_to_free);
+    return;
+  }
   block_set_allocated(block_to_free, 0);
   insert_free_block(block_to_free);
-  coalesce(block_to_free);
+  block_to_free = coalesce(block_to_free, 0);
+  if (block_next(block_to_free) == epilogue) {
+    trim_heap(block_to_free);
+  }
   return;
 }
 
@@ -294,11 +527,20 @@ void *mm_realloc(void *ptr, size_t size) {
     mm_free(ptr);
     return ptr;
   }
+  if (size > MAX_REQUEST) {
+    return NULL;
+  }
+  if (flushed) {
+    mark_dirty();
+  }
   size = align(size);  // making sure it's aligned.
   if(size + TAGS_SIZE < MINBLOCKSIZE){
     size = MINBLOCKSIZE - TAGS_SIZE;
   }
   block_t *original_block = payload_to_block(ptr);
+  if (block_mapped(original_block)) {
+    return remap_block(original_block, size);
+  }
   size_t original_payload_size = block_size(original_block) - TAGS_SIZE;
   if (size == original_payload_size) {// do nothing
     return ptr;
@@ -327,7 +569,7 @@ void *mm_realloc(void *ptr, size_t size) {
         pull_free_block(prev);
         memmove(prev->payload, original_block->payload, original_payload_size);
         block_set_size_and_allocated(prev, available_space, 1);
-        split_block(prev, size + TAGS_SIZE);  // size + TAGS_SIZE is the size of the reallocated block.
+        split_block(prev, size + TAGS_SIZE, 0);  // the leftover may hold old payload pages, which are resident.
         return prev->payload;
       }
        // CASE 2: prev is free, next is free
@@ -336,7 +578,7 @@ void *mm_realloc(void *ptr, size_t size) {
         pull_free_block(next);
         memmove(prev->payload, original_block->payload, original_payload_size);
         block_set_size_and_allocated(prev, available_space, 1);
-        split_block(prev, size + TAGS_SIZE);  // size + TAGS_SIZE is the size of the reallocated block.
+        split_block(prev, size + TAGS_SIZE, 0);  // the leftover may hold old payload pages, which are resident.
         return prev->payload;
       }
 
@@ -344,7 +586,7 @@ void *mm_realloc(void *ptr, size_t size) {
       if (!prev_free && next_free) {
         pull_free_block(next);
         block_set_size_and_allocated(original_block, available_space, 1);
-        split_block(original_block, size + TAGS_SIZE);  // size + TAGS_SIZE is the size of the reallocated block.
+        split_block(original_block, size + TAGS_SIZE, 1);  // the leftover lies inside what was next.
         return original_block->payload;
       }
     } else {  // the neighbors don't have enough space, so we are gonna have to call malloc.
@@ -361,6 +603,289 @@ void *mm_realloc(void *ptr, size_t size) {
 }
 
 
+/*
+* gives a block with a payload of at least size its own mapping from memlib, outside the
+* heap segments. it has the usual tags, and MAPPED set in its header tells free and
+* realloc to hand it back to memlib instead of the free lists. its neighbours are not
+* heap blocks, so nothing ever coalesces with it.
+* arguments: size: the payload size, already aligned
+* returns: the allocated block, or NULL if memlib could not map it
+*/
+static block_t *map_block(size_t size) {
+  block_t *b = mem_map_block(size + TAGS_SIZE);
+  if (b == NULL) {
+    return NULL;
+  }
+  b->size = mem_block_size(b);
+  *block_end_tag(b) = b->size | 1;
+  b->size |= MAPPED | 1;
+  return b;
+}
+
+/*
+* resizes a mapped block for realloc. the block stays mapped, and mremap moves its pages
+* without copying them, unless size has dropped below the mmap threshold, in which case
+* the payload is copied into a heap block and the mapping given back.
+* arguments: b: a mapped block
+*            size: the new payload size, already aligned
+* returns: the new payload, or NULL if the block could not be resized (b is unchanged)
+*/
+static void *remap_block(block_t *b, size_t size) {
+  if (size < mmap_threshold) {
+    void *payload = mm_malloc(size);
+    if (payload == NULL) {
+      return NULL;
+    }
+    memcpy(payload, b->payload, size);
+    mem_unmap_block(b);
+    return payload;
+  }
+  if ((b = mem_remap_block(b, size + TAGS_SIZE)) == NULL) {
+    return NULL;
+  }
+  b->size = mem_block_size(b);
+  *block_end_tag(b) = b->size | 1;
+  b->size |= MAPPED | 1;
+  return b->payload;
+}
+
+
+/*
+* returns the number of payload bytes usable in an allocated block, which
+* may be more than was asked for because of alignment and splitting.
+* arguments: ptr: a pointer to the block's payload
+*/
+size_t mm_usable_size(void *ptr) {
+  return block_size(payload_to_block(ptr)) - TAGS_SIZE;
+}
+
+
+/*
+* reports the number of blocks on the free list and the size of the largest
+* one, so mdriver's timeline mode can follow fragmentation over a trace.
+* arguments: free_blocks, largest_free: filled in on return
+* returns: nothing
+*/
+void mm_free_stats(size_t *free_blocks, size_t *largest_free) {
+  *free_blocks = 0;
+  *largest_free = 0;
+  for (int i = 0; i < MM_NUM_CLASSES; i++) {
+    block_t *curr_block = flists[i];
+    if (curr_block == NULL) {
+      continue;
+    }
+    do {
+      (*free_blocks)++;
+      if (block_size(curr_block) > *largest_free) {
+        *largest_free = block_size(curr_block);
+      }
+      curr_block = block_next_free(curr_block);
+    } while (curr_block != flists[i]);
+  }
+}
+
+
+// what mm_snapshot writes ahead of memlib's image of the heap: everything mm keeps outside it.
+typedef struct {
+  size_t magic;
+  int num_classes;
+  int num_segments;
+  block_t *segments[MEM_MAX_SEGMENTS];
+  block_t *epilogue;
+  block_t *flists[MM_NUM_CLASSES];
+  size_t extend_min;
+  char *heap_base;
+} snapshot_t;
+
+#define SNAPSHOT_MAGIC ((size_t)0x6d6d736e61703031)  // "mmsnap01"
+
+/*
+* writes the heap to the file at path so that mm_restore can bring it back later, in this
+* process or another one: mm's own pointers into the heap, then every segment's bytes.
+* arguments: path: the file to create or overwrite
+* returns: 0, if successful
+*         -1, if the file could not be written
+*/
+int mm_snapshot(const char *path) {
+  snapshot_t snap;
+  int fd, ret;
+  memset(&snap, 0, sizeof(snap));
+  snap.magic = SNAPSHOT_MAGIC;
+  snap.num_classes = MM_NUM_CLASSES;
+  snap.num_segments = num_segments;
+  memcpy(snap.segments, segments, num_segments * sizeof(block_t *));
+  snap.epilogue = epilogue;
+  memcpy(snap.flists, flists, sizeof(flists));
+  snap.extend_min = extend_min;
+  snap.heap_base = heap_base;
+
+  if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0) {
+    return -1;
+  }
+  ret = (write(fd, &snap, sizeof(snap)) == sizeof(snap)) ? mem_save(fd) : -1;
+  if (close(fd) < 0) {
+    ret = -1;
+  }
+  return ret;
+}
+
+/*
+* replaces the heap with one written by mm_snapshot, in place of mm_init. this is a warm
+* start: the blocks that were allocated are allocated again, at the same offsets in their
+* segments, with the same contents, without replaying the requests that made them.
+* memlib puts the segments back where they were if it can. if any moved, every pointer
+* mm keeps into the heap is relocated: the segment and free list roots here and, when
+* there are several segments that need not have moved together, the links of each free
+* block, which are offsets from the first one. a heap in one segment, like the sizes in
+* the tags, is position independent, so its blocks are never touched and a mapped heap
+* only reads in the pages it goes on to use.
+* arguments: path: a file written by mm_snapshot, with the same size classes
+* returns: 0, if successful
+*         -1, if the file could not be read or does not fit; the heap is then empty and
+*             must be set up again with mm_init
+*/
+int mm_restore(const char *path) {
+  snapshot_t snap;
+  int fd, moved;
+  if ((fd = open(path, O_RDONLY)) < 0) {
+    return -1;
+  }
+  if (read(fd, &snap, sizeof(snap)) != sizeof(snap) || snap.magic != SNAPSHOT_MAGIC ||
+      snap.num_classes != MM_NUM_CLASSES || snap.num_segments < 1 ||
+      snap.num_segments > MEM_MAX_SEGMENTS) {
+    close(fd);
+    return -1;
+  }
+  moved = mem_load(fd);
+  close(fd);
+  if (moved < 0) {
+    return -1;
+  }
+
+  num_segments = snap.num_segments;
+  for (int i = 0; i < num_segments; i++) {
+    segments[i] = mem_relocate(snap.segments[i]);
+  }
+  prologue = segments[num_segments - 1];
+  epilogue = mem_relocate(snap.epilogue);
+  extend_min = snap.extend_min;
+  heap_base = mem_heap_lo();
+  for (int i = 0; i < MM_NUM_CLASSES; i++) {
+    flists[i] = mem_relocate(snap.flists[i]);
+    if (!moved || num_segments == 1 || flists[i] == NULL) {
+      continue;
+    }
+    block_t *curr_block = flists[i];
+    do {
+      block_t *next = mem_relocate(snap.heap_base + (ptrdiff_t) curr_block->payload[0]);
+      block_set_prev_free(curr_block,
+                          mem_relocate(snap.heap_base + (ptrdiff_t) curr_block->payload[1]));
+      block_set_next_free(curr_block, next);
+      curr_block = next;
+    } while (curr_block != flists[i]);
+  }
+  mark_dirty();
+  return 0;
+}
+
+/*
+* marks the root dirty, on disk too for a file-backed heap, before the heap first changes
+* after mm_flush. pages of a file mapping can be written back at any time, so this is what
+* keeps mm_open from taking a heap that was halfway through changing for a flushed one.
+*/
+static void mark_dirty(void) {
+  ((root_t *) heap_base)->state = ROOT_DIRTY;
+  mem_flush(heap_base, sizeof(root_t));
+  flushed = 0;
+}
+
+/*
+* makes the heap durable: for a heap in a file (mem_init_file), waits until its blocks and
+* then its root are on disk, so that mm_open can take it up again after the process exits
+* or crashes. the root is written last and says the heap is clean until the next malloc,
+* free or realloc, so a crash at any point leaves a file that mm_open either reopens in the
+* state of the last mm_flush or refuses. other heaps are not written anywhere, but get the
+* same root.
+* arguments: none
+* returns: 0, if successful
+*         -1, if the heap has more than one segment or could not be written
+*/
+int mm_flush(void) {
+  root_t *root = (root_t *) heap_base;
+  if (num_segments > 1) {
+    return -1;
+  }
+  if (!flushed && mem_flush(prologue, (char *) epilogue + TAGS_SIZE - (char *) prologue) < 0) {
+    return -1;
+  }
+  mm_detach();
+  root->state = ROOT_CLEAN;
+  if (mem_flush(root, sizeof(root_t)) < 0) {
+    return -1;
+  }
+  flushed = 1;
+  return 0;
+}
+
+/*
+* takes up the heap that memlib already holds, e.g. one that mem_init_file found in its
+* file, in place of mm_init. everything comes from the root, so this is O(1) whatever the
+* size of the heap: the free list links are offsets and need no fixing wherever the heap
+* now is. the brk, which memlib put at the end of the file, moves back to the end of the
+* heap the root records.
+* arguments: none
+* returns: 0, if successful
+*         -1, if there is no heap left by mm_flush, or it has changed since; the caller
+*             should then start a new one with mem_reset_brk and mm_init
+*/
+int mm_open(void) {
+  root_t *root = (root_t *) mem_heap_lo();
+  size_t size = mem_heapsize();
+  if (size < ROOT_SIZE + 2 * TAGS_SIZE || root->magic != ROOT_MAGIC ||
+      root->state != ROOT_CLEAN || root->num_classes != MM_NUM_CLASSES ||
+      root->end < ROOT_SIZE + 2 * TAGS_SIZE || root->end > size) {
+    return -1;
+  }
+  if (mem_sbrk(-(intptr_t) (size - root->end)) == (void *) -1) {
+    return -1;
+  }
+  mm_attach();
+  flushed = 1;
+  return 0;
+}
+
+/*
+* mm_attach loads everything mm keeps outside the blocks from the root, and mm_detach
+* stores it there. between them, several processes can take turns on one heap in shared
+* memory (mem_init_shm), each with the heap mapped at its own address: every call into mm
+* goes between mem_lock, mm_attach and mm_detach, mem_unlock, so that each process
+* starts from the lists the last one left. the heap must be one segment.
+* arguments: none
+* returns: nothing
+*/
+void mm_attach(void) {
+  root_t *root = (root_t *) mem_heap_lo();
+  heap_base = (char *) root;
+  prologue = (block_t *) (heap_base + ROOT_SIZE);
+  epilogue = (block_t *) (heap_base + root->end - TAGS_SIZE);
+  segments[0] = prologue;
+  num_segments = 1;
+  extend_min = root->extend_min;
+  for (int i = 0; i < MM_NUM_CLASSES; i++) {
+    flists[i] = (root->flists[i] == 0) ? NULL : (block_t *) (heap_base + root->flists[i]);
+  }
+}
+
+void mm_detach(void) {
+  root_t *root = (root_t *) heap_base;
+  root->end = (char *) epilogue + TAGS_SIZE - heap_base;
+  root->extend_min = extend_min;
+  for (int i = 0; i < MM_NUM_CLASSES; i++) {
+    root->flists[i] = (flists[i] == NULL) ? 0 : (size_t) ((char *) flists[i] - heap_base);
+  }
+}
+
+
 /*
 * checks the state of the heap for internal consistency and prints informative
 * error messages
@@ -370,25 +895,32 @@ void *mm_realloc(void *ptr, size_t size) {
 */
 int mm_check_heap(void) {
   //printf("%s\n", "entering mm_check_heap");
-  block_t *curr_block = prologue;
+  block_t *curr_block;
   /*
   (1) check to make sure that size is multiple of 8
   (2) make sure there are no overlaps, meaning that current + size is a new block's header.
   (3) subtract 8 from current + size to get the footer. make sure footer is same as header.
   (4) are there any adjacent free blocks?
-  (5) within bounds of pro and epilogue
+  (5) within the heap of a segment; the last segment ends at epilogue
   (6) free list stuff
   (a) every block in free list is marked as free
   (b) are all the blocks in the free list valid?
+  (c) is every free block on the list of its size class?
   */
-  curr_block = block_next(curr_block); // skipping over checking the prologue.
-  while (curr_block != epilogue) { // heap iterator
+  for (int seg = 0; seg < num_segments; seg++) { // every segment is a chain of its own
+  curr_block = block_next(segments[seg]); // skipping over checking the prologue.
+  while (block_size(curr_block) != TAGS_SIZE) { // heap iterator, up to the segment's epilogue
     // (1) checking for size 8
     if (block_size(curr_block) % 8)  {
       fprintf(stderr, "heap error: %s\n block information: problem block's address: %p,  size: %zu\n", "not aligned to 8.",
       (void *) curr_block, block_size(curr_block));
       return -1;
     }
+    if (block_size(curr_block) < MINBLOCKSIZE)  {
+      fprintf(stderr, "heap error: %s\n block information: problem block's address: %p,  size: %zu\n",
+      "smaller than MINBLOCKSIZE.", (void *) curr_block, block_size(curr_block));
+      return -1;
+    }
 
     // (3) TODO: check header and foot to see if they're the same.
     if (block_size(curr_block) != block_end_size(curr_block) ||
@@ -403,25 +935,39 @@ int mm_check_heap(void) {
     "there are contiguous free blocks.", (void *) curr_block, block_size(curr_block));
     return -1;
   }
-  // (5) check to see if it's between prologue and epilogue
-  if (curr_block > epilogue || curr_block < prologue) {
+  // (5) check to see if it's within the heap of one segment
+  if (!mem_in_heap(curr_block, block_size(curr_block))) {
     fprintf(stderr, "heap error: %s\n block information: problem block's address: %p,  size: %zu\n",
-    "block is not within bounds of epilogue / prologue.", (void *) curr_block, block_size(curr_block));
+    "block is not within the bounds of a heap segment.", (void *) curr_block, block_size(curr_block));
     return -1;
   }
   curr_block = block_next(curr_block);
 }
-curr_block = flist_first;
-if (curr_block == NULL) {
-  return 0;
-}
-do {
-  if (block_allocated(curr_block)) {
+  if (seg == num_segments - 1 && curr_block != epilogue) {
     fprintf(stderr, "heap error: %s\n block information: problem block's address: %p,  size: %zu\n",
-    "block in free list is not marked free.", (void *) curr_block, block_size(curr_block));
+    "last segment does not end at the epilogue.", (void *) curr_block, block_size(curr_block));
     return -1;
   }
-  curr_block = block_next_free(curr_block);
-} while (curr_block != flist_first);
+  }
+for (int i = 0; i < MM_NUM_CLASSES; i++) {
+  curr_block = flists[i];
+  if (curr_block == NULL) {
+    continue;
+  }
+  do {
+    if (block_allocated(curr_block)) {
+      fprintf(stderr, "heap error: %s\n block information: problem block's address: %p,  size: %zu\n",
+      "block in free list is not marked free.", (void *) curr_block, block_size(curr_block));
+      return -1;
+    }
+    // (c) every block is on the list of its size class
+    if (size_class(block_size(curr_block)) != i) {
+      fprintf(stderr, "heap error: %s\n block information: problem block's address: %p,  size: %zu\n",
+      "block is in the free list of another size class.", (void *) curr_block, block_size(curr_block));
+      return -1;
+    }
+    curr_block = block_next_free(curr_block);
+  } while (curr_block != flists[i]);
+}
 return 0;
 }
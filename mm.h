@@ -4,9 +4,20 @@
 #include <stdio.h>
 
 int mm_init(void);
+int mm_init_hint(size_t expected_peak);
 void *mm_malloc(size_t size);
 void mm_free(void *ptr);
 void *mm_realloc(void *ptr, size_t size);
+size_t mm_usable_size(void *ptr);
+void mm_free_stats(size_t *free_blocks, size_t *largest_free);
+void mm_set_release_threshold(size_t bytes);
+void mm_set_mmap_threshold(size_t bytes);
+int mm_snapshot(const char *path);
+int mm_restore(const char *path);
+int mm_open(void);
+int mm_flush(void);
+void mm_attach(void);
+void mm_detach(void);
 
 #define ALIGNMENT 8
 #define WORD_SIZE (sizeof(size_t))
@@ -24,8 +35,9 @@ typedef struct block {
     size_t payload[];
     // This array represents 
     // for free blocks:
-    //     payload[0] is the pointer to next free block;
-    //     payload[1] is the pointer to the previous free block
+    //     payload[0] is the offset of the next free block from the start
+    //     of the heap;
+    //     payload[1] is the offset of the previous free block
     // there is a copy of the size field at the end of the block
 } block_t;
 
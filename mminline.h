@@ -3,7 +3,29 @@
 // This file defines inline functions to manipulate blocks and the free list
 // NOTE: to be included only in mm.c
 
-static block_t *flist_first;  // head of circular, doubly linked free list
+// heads of the circular, doubly linked free lists, one per size class
+// (see mm_classes.h). A free block is on the list of its own size's class.
+static block_t *flists[MM_NUM_CLASSES];
+
+// the first byte of the heap (mem_heap_lo). free list links are stored as
+// offsets from here rather than as pointers, so that they stay valid
+// wherever the heap is mapped (see mm_open).
+static char *heap_base;
+
+// returns the class of a block of the given size (tags included): the first
+// class whose bound is at least size, or the last class if none is
+static inline int size_class(size_t size) {
+    int lo = 0, hi = MM_NUM_CLASSES - 1;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (mm_class_size[mid] >= size) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return lo;
+}
 
 // returns a pointer to the block's end tag (You probably won't need to use this
 // directly)
@@ -25,10 +47,15 @@ static inline int block_end_allocated(block_t *b) {
     return *block_end_tag(b) & 1;
 }
 
+// returns 1 if the block has a mapping of its own outside the heap (see
+// map_block in mm.c), 0 otherwise. Only the header of such a block carries
+// the bit, which is the second from the right.
+static inline int block_mapped(block_t *b) { return (b->size & 2) != 0; }
+
 // returns the size of the entire block
-// NOTE: -2 is 111...1110 in binary, so the '& -2' removes the 'is-allocated'
-// bit from the size
-static inline size_t block_size(block_t *b) { return b->size & -2; }
+// NOTE: -8 is 111...1000 in binary, so the '& -8' removes the 'is-allocated'
+// and 'is-mapped' bits from the size
+static inline size_t block_size(block_t *b) { return b->size & -8; }
 
 // same as the above, but uses the end tag of the block
 static inline size_t block_end_size(block_t *b) {
@@ -111,38 +138,41 @@ static inline block_t *payload_to_block(void *payload) {
 }
 
 // returns a pointer to the next free block
-// NOTE: if 'b' is free, b->payload[0] contains a pointer to the next free block
+// NOTE: if 'b' is free, b->payload[0] contains the offset of the next free
+// block from heap_base
 static inline block_t *block_next_free(block_t *b) {
     assert(!block_allocated(b));
-    return (block_t *)b->payload[0];
+    return (block_t *)(heap_base + (ptrdiff_t)b->payload[0]);
 }
 
 // sets the pointer to the next free block
 static inline void block_set_next_free(block_t *b, block_t *next) {
     assert(!block_allocated(b) && !block_allocated(next));
-    b->payload[0] = (size_t)next;
+    b->payload[0] = (char *)next - heap_base;
 }
 
 // returns a pointer to the previous free block
-// NOTE: if 'b' is free, b->payload[1] contains a pointer to the previous free
-// block
+// NOTE: if 'b' is free, b->payload[1] contains the offset of the previous
+// free block from heap_base
 static inline block_t *block_prev_free(block_t *b) {
     assert(!block_allocated(b));
-    return (block_t *)b->payload[1];
+    return (block_t *)(heap_base + (ptrdiff_t)b->payload[1]);
 }
 
 // sets the pointer to the previous free block
 static inline void block_set_prev_free(block_t *b, block_t *prev) {
     assert(!block_allocated(b) && !block_allocated(prev));
-    b->payload[1] = (size_t)prev;
+    b->payload[1] = (char *)prev - heap_base;
 }
 
-// pull a block from the (circularly doubly linked) free list
+// pull a block from the (circularly doubly linked) free list of its class.
+// NOTE: the block's size must not have changed since it was inserted
 static inline void pull_free_block(block_t *fb) {
     assert(!block_allocated(fb));
-    if (flist_first == fb) {
-        if ((flist_first = block_next_free(fb)) == fb) {
-            flist_first = NULL;
+    block_t **flist_first = &flists[size_class(block_size(fb))];
+    if (*flist_first == fb) {
+        if ((*flist_first = block_next_free(fb)) == fb) {
+            *flist_first = NULL;
             return;
         }
     }
@@ -150,17 +180,18 @@ static inline void pull_free_block(block_t *fb) {
     block_set_prev_free(block_next_free(fb), block_prev_free(fb));
 }
 
-// insert block into the (circularly doubly linked) free list
+// insert block into the (circularly doubly linked) free list of its class
 static inline void insert_free_block(block_t *fb) {
     assert(!block_allocated(fb));
-    if (flist_first != NULL) {
-        block_t *last = block_prev_free(flist_first);
+    block_t **flist_first = &flists[size_class(block_size(fb))];
+    if (*flist_first != NULL) {
+        block_t *last = block_prev_free(*flist_first);
         // put 'fb' in between 'flist_first' and 'last'
-        block_set_next_free(fb, flist_first);
+        block_set_next_free(fb, *flist_first);
         block_set_prev_free(fb, last);
         // update 'last' and 'flist_first' so they point to 'fb'
         block_set_next_free(last, fb);
-        block_set_prev_free(flist_first, fb);
+        block_set_prev_free(*flist_first, fb);
     } else {
         // The free list is empty, so when we insert fb, it will be the
         // only element in the list.
@@ -169,7 +200,7 @@ static inline void insert_free_block(block_t *fb) {
         block_set_next_free(fb, fb);
         block_set_prev_free(fb, fb);
     }
-    flist_first = fb;
+    *flist_first = fb;
 }
 
 #endif  // MMINLINE_H_
@@ -0,0 +1,345 @@
+/*
+ * mmpreload.c - Run mm.c as the malloc of an unmodified program.
+ *
+ * Built into libmm.so, which defines the standard allocation entry
+ * points on top of mm_malloc, mm_free and mm_realloc:
+ *
+ *     LD_PRELOAD=./libmm.so ls -l
+ *
+ * The simulated heap is a range of address space reserved by
+ * mem_init_reserve, sized by the MM_HEAP_SIZE environment variable
+ * (bytes, default DEFAULT_HEAP). Pages are committed as the heap grows
+ * and given back when mm trims it. MM_HEAP_HINT, if set, is the expected peak of
+ * live bytes, which mm_init_hint commits up front. MM_HUGEPAGES=1 backs
+ * the heap with 2 MB huge pages (mem_set_hugepages), and MM_RELEASE, if
+ * set, is the size of free block whose pages mm gives back to the kernel
+ * (mm_set_release_threshold). MM_MMAP, if set, is the size of request
+ * that gets a mapping of its own, so realloc can grow it with mremap
+ * instead of copying (mm_set_mmap_threshold). mm is not thread
+ * safe, so every call holds one global lock.
+ *
+ * Initialization happens on the first allocation and calls nothing that
+ * can allocate. If an allocation arrives while this thread is already
+ * inside mm (e.g. from a library call made by the allocator itself) it
+ * is served from a small static bootstrap arena instead of re-entering
+ * mm; frees of arena memory are ignored.
+ *
+ * mm only guarantees ALIGNMENT-byte payloads, but programs compiled
+ * against glibc assume MALLOC_ALIGN (16 on x86-64) and use aligned SSE
+ * moves on malloc'd memory. A payload that is not aligned enough is
+ * over-allocated and the pointer we return stores, in the word before
+ * it, its (even) distance from the real payload. That word is a block
+ * header with the allocated bit set, i.e. odd, for every other pointer
+ * we hand out, which is how free tells them apart.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define DEFAULT_HEAP ((size_t)1 << 30)  /* 1 GB of address space */
+#define ARENA_SIZE   (64 * 1024)        /* bootstrap arena for reentry */
+
+/* alignment the C library promises for malloc */
+#define MALLOC_ALIGN (2 * sizeof(size_t))
+
+/* largest request we pass on to mm */
+#define MAX_REQUEST  ((size_t)PTRDIFF_MAX / 2)
+
+static pthread_mutex_t mm_lock = PTHREAD_MUTEX_INITIALIZER;
+static int initialized = 0;
+static __thread int in_mm = 0;  /* set while this thread is inside mm */
+
+static char arena[ARENA_SIZE] __attribute__((aligned(16)));
+static size_t arena_used = 0;
+
+/*
+ * parse_size - Parse a byte count with mem_parse_size, which allocates
+ *     nothing, treating a malformed one as unset (0)
+ */
+static size_t parse_size(const char *s) {
+    size_t n;
+
+    return (mem_parse_size(s, &n) == 0) ? n : 0;
+}
+
+/*
+ * preload_prepare, preload_parent, preload_child - Hold the lock across
+ *     fork so the child never inherits a heap in mid-update
+ */
+static void preload_prepare(void) {
+    pthread_mutex_lock(&mm_lock);
+}
+
+static void preload_parent(void) {
+    pthread_mutex_unlock(&mm_lock);
+}
+
+static void preload_child(void) {
+    pthread_mutex_unlock(&mm_lock);
+}
+
+/*
+ * preload_init - Set up the heap. Called with mm_lock held.
+ */
+static void preload_init(void) {
+    char *env = getenv("MM_HEAP_SIZE");
+    size_t heap = (env != NULL) ? parse_size(env) : 0;
+    size_t hint;
+
+    env = getenv("MM_HEAP_HINT");
+    hint = (env != NULL) ? parse_size(env) : 0;
+
+    mem_set_max_heap(heap ? heap : DEFAULT_HEAP);
+    env = getenv("MM_HUGEPAGES");
+    mem_set_hugepages(env != NULL && *env == '1');
+    env = getenv("MM_RELEASE");
+    mm_set_release_threshold((env != NULL) ? parse_size(env) : 0);
+    env = getenv("MM_MMAP");
+    mm_set_mmap_threshold((env != NULL) ? parse_size(env) : 0);
+    mem_init_reserve();
+    if (mm_init_hint(hint) != 0)
+        abort();
+    pthread_atfork(preload_prepare, preload_parent, preload_child);
+    initialized = 1;
+}
+
+/*
+ * arena_alloc - Serve a reentrant request from the bootstrap arena.
+ *     Each chunk is preceded by its size so realloc can copy it out.
+ */
+static void *arena_alloc(size_t size) {
+    size_t *chunk;
+    size_t need = ((size + 15) & ~(size_t)15) + 16;
+
+    if (size > ARENA_SIZE || arena_used + need > ARENA_SIZE)
+        return NULL;
+    chunk = (size_t *)(arena + arena_used);
+    arena_used += need;
+    chunk[0] = size;
+    return chunk + 2;
+}
+
+/* in_arena - Was p handed out by arena_alloc? */
+static int in_arena(void *p) {
+    return (char *)p >= arena && (char *)p < arena + ARENA_SIZE;
+}
+
+/*
+ * real_payload - Map a pointer we returned back to the mm payload
+ */
+static void *real_payload(void *p) {
+    size_t tag = ((size_t *)p)[-1];
+    return (tag & 1) ? p : (char *)p - tag;
+}
+
+/*
+ * usable - Bytes usable at p, which is not NULL and not in the arena
+ */
+static size_t usable(void *p) {
+    void *payload = real_payload(p);
+    return mm_usable_size(payload) - ((char *)p - (char *)payload);
+}
+
+/*
+ * locked_malloc, locked_free, locked_memalign - The allocation paths,
+ *     run with mm_lock held and in_mm set
+ */
+static void *locked_malloc(size_t size) {
+    if (!initialized)
+        preload_init();
+    return mm_malloc(size);
+}
+
+static int aligned(void *p, size_t alignment) {
+    return ((uintptr_t)p & (alignment - 1)) == 0;
+}
+
+static void locked_free(void *p) {
+    mm_free(real_payload(p));
+}
+
+static void *locked_memalign(size_t alignment, size_t size) {
+    char *payload, *p;
+
+    /* payloads are ALIGNMENT-aligned, so the shift is at most this */
+    if ((payload = locked_malloc(size + alignment - ALIGNMENT)) == NULL)
+        return NULL;
+    if (aligned(payload, alignment))
+        return payload;
+
+    /* Leave room for the distance word before the aligned pointer */
+    p = (char *)(((uintptr_t)payload + WORD_SIZE + alignment - 1) &
+                 ~(uintptr_t)(alignment - 1));
+    ((size_t *)p)[-1] = p - payload;
+    return p;
+}
+
+/*************************************
+ * The standard allocation interface
+ ************************************/
+
+void *malloc(size_t size) {
+    void *p;
+
+    if (in_mm)
+        return arena_alloc(size);
+    if (size == 0)
+        size = 1;
+    if (size > MAX_REQUEST) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    pthread_mutex_lock(&mm_lock);
+    in_mm = 1;
+    p = locked_memalign(MALLOC_ALIGN, size);
+    in_mm = 0;
+    pthread_mutex_unlock(&mm_lock);
+
+    if (p == NULL)
+        errno = ENOMEM;
+    return p;
+}
+
+void free(void *p) {
+    if (p == NULL || in_arena(p) || in_mm)
+        return;
+
+    pthread_mutex_lock(&mm_lock);
+    in_mm = 1;
+    locked_free(p);
+    in_mm = 0;
+    pthread_mutex_unlock(&mm_lock);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+    void *p;
+
+    if (size != 0 && nmemb > MAX_REQUEST / size) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    /* mm reuses freed blocks, so the memory is not known to be zero */
+    if ((p = malloc(nmemb * size)) != NULL)
+        memset(p, 0, nmemb * size);
+    return p;
+}
+
+void *realloc(void *p, size_t size) {
+    void *newp;
+    size_t oldsize;
+
+    if (p == NULL)
+        return malloc(size);
+    if (size == 0) {
+        free(p);
+        return NULL;
+    }
+    if (size > MAX_REQUEST) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    /* Arena chunks and over-aligned blocks are moved by hand */
+    if (in_arena(p) || !(((size_t *)p)[-1] & 1)) {
+        oldsize = in_arena(p) ? ((size_t *)p)[-2] : usable(p);
+        if ((newp = malloc(size)) == NULL)
+            return NULL;
+        memcpy(newp, p, (oldsize < size) ? oldsize : size);
+        free(p);
+        return newp;
+    }
+
+    pthread_mutex_lock(&mm_lock);
+    in_mm = 1;
+    oldsize = usable(p);
+    newp = mm_realloc(p, size);
+    if (newp != NULL && !aligned(newp, MALLOC_ALIGN)) {
+        /*
+         * mm moved the block to a payload we cannot return as is. If
+         * there is no room for an aligned copy, newp holds the only copy
+         * of the data, so hand it back only ALIGNMENT-aligned.
+         */
+        if ((p = locked_memalign(MALLOC_ALIGN, size)) != NULL) {
+            memcpy(p, newp, (oldsize < size) ? oldsize : size);
+            mm_free(newp);
+            newp = p;
+        }
+    }
+    in_mm = 0;
+    pthread_mutex_unlock(&mm_lock);
+
+    if (newp == NULL)
+        errno = ENOMEM;
+    return newp;
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size) {
+    void *p;
+
+    if (alignment < sizeof(void *) || (alignment & (alignment - 1)) != 0)
+        return EINVAL;
+    if (alignment < MALLOC_ALIGN)
+        alignment = MALLOC_ALIGN;
+    if (size > MAX_REQUEST || alignment > MAX_REQUEST)
+        return ENOMEM;
+    if (size == 0)
+        size = 1;
+
+    if (in_mm) {
+        /* the arena hands out MALLOC_ALIGN-aligned chunks */
+        if (alignment > MALLOC_ALIGN || (p = arena_alloc(size)) == NULL)
+            return ENOMEM;
+        *memptr = p;
+        return 0;
+    }
+
+    pthread_mutex_lock(&mm_lock);
+    in_mm = 1;
+    p = locked_memalign(alignment, size);
+    in_mm = 0;
+    pthread_mutex_unlock(&mm_lock);
+
+    if (p == NULL)
+        return ENOMEM;
+    *memptr = p;
+    return 0;
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    void *p;
+    int err;
+
+    if ((err = posix_memalign(&p, alignment, size)) != 0) {
+        errno = err;
+        return NULL;
+    }
+    return p;
+}
+
+void *memalign(size_t alignment, size_t size) {
+    return aligned_alloc(alignment, size);
+}
+
+void *valloc(size_t size) {
+    return aligned_alloc(mem_pagesize(), size);
+}
+
+void *pvalloc(size_t size) {
+    size_t page = mem_pagesize();
+    return aligned_alloc(page, (size + page - 1) & ~(page - 1));
+}
+
+size_t malloc_usable_size(void *p) {
+    if (p == NULL)
+        return 0;
+    if (in_arena(p))
+        return ((size_t *)p)[-2];
+    return usable(p);
+}
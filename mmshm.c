@@ -0,0 +1,97 @@
+/*
+ * mmshm.c - Share one mm heap between processes.
+ *
+ * The heap is a POSIX shared memory object set up by mem_init_shm. One
+ * process makes it with mmshm_create and any number of others attach
+ * to it with mmshm_open; after that a block malloc'd in one process can
+ * be handed to another, which reads it in place and may free it:
+ *
+ *     producer                        consumer
+ *     p = mmshm_malloc(n);
+ *     ... fill p ...
+ *     send(mmshm_offset(p))   ----->  p = mmshm_pointer(receive());
+ *                                     ... read p ...
+ *                                     mmshm_free(p);
+ *
+ * Each process maps the heap at its own address, so blocks are passed
+ * as offsets from mem_heap_lo, and mm's free list links are offsets too.
+ * Every call holds the lock in the heap's first page (mem_lock) and
+ * brings mm's own state in from the heap's root (mm_attach) before
+ * leaving it there for the next process (mm_detach). The calls are
+ * therefore serialized across all the processes, which is fine for the
+ * large buffers this is meant for; small, frequent requests are better
+ * served by a private heap.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "mmshm.h"
+
+/*
+ * mmshm_create - Make the shared memory object name, which must not
+ *     exist yet, with room for a heap of size bytes, and start an empty
+ *     heap in it. Returns 0, or -1 on error.
+ */
+int mmshm_create(const char *name, size_t size) {
+    int ret;
+
+    mem_set_max_heap(size);
+    if (mem_init_shm(name, 1) < 0)
+        return -1;
+    mem_lock();
+    if ((ret = mm_init()) == 0)
+        mm_detach();
+    mem_unlock();
+    return (ret == 0) ? 0 : -1;
+}
+
+/*
+ * mmshm_open - Attach to the heap another process made with
+ *     mmshm_create. Returns 0, or -1 on error.
+ */
+int mmshm_open(const char *name) {
+    return mem_init_shm(name, 0);
+}
+
+/*
+ * mmshm_close - Unmap the heap. The object stays until shm_unlink.
+ */
+void mmshm_close(void) {
+    mem_deinit();
+}
+
+/*
+ * mmshm_malloc, mmshm_free - mm_malloc and mm_free on the shared heap
+ */
+void *mmshm_malloc(size_t size) {
+    void *p;
+
+    mem_lock();
+    mm_attach();
+    p = mm_malloc(size);
+    mm_detach();
+    mem_unlock();
+    return p;
+}
+
+void mmshm_free(void *p) {
+    mem_lock();
+    mm_attach();
+    mm_free(p);
+    mm_detach();
+    mem_unlock();
+}
+
+/*
+ * mmshm_offset, mmshm_pointer - Convert between a payload in this
+ *     process and the offset that names it in every process
+ */
+size_t mmshm_offset(void *p) {
+    return (char *)p - (char *)mem_heap_lo();
+}
+
+void *mmshm_pointer(size_t offset) {
+    return (char *)mem_heap_lo() + offset;
+}
@@ -0,0 +1,17 @@
+/*
+ * mmshm.h - One mm heap shared by several processes (see mmshm.c)
+ */
+#ifndef MMSHM_H_
+#define MMSHM_H_
+
+#include <stddef.h>
+
+int mmshm_create(const char *name, size_t size);
+int mmshm_open(const char *name);
+void mmshm_close(void);
+void *mmshm_malloc(size_t size);
+void mmshm_free(void *p);
+size_t mmshm_offset(void *p);
+void *mmshm_pointer(size_t offset);
+
+#endif  // MMSHM_H_
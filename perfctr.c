@@ -0,0 +1,140 @@
+/*
+ * perfctr.c - Count hardware events (cycles, cache and TLB misses, ...)
+ *     used by a function, via the Linux perf_event_open interface.
+ *
+ * Each counter is opened on its own rather than as a group, so a host
+ * that lacks one event (common for dTLB and LLC events in VMs) still
+ * reports the others. On hosts without perf_event support every
+ * counter reads as unavailable.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "perfctr.h"
+
+char *perfctr_names[PERFCTR_NUM] = {
+    "cycles", "instrs", "l1d_miss", "llc_miss", "dtlb_miss", "br_miss"
+};
+
+#ifdef __linux__
+
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#define CACHE_READ_MISS(cache) \
+    ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | \
+     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+/* perf event type and config for each counter */
+static struct {
+    unsigned type;
+    unsigned long long config;
+} events[PERFCTR_NUM] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_L1D)},
+    {PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_LL)},
+    {PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_DTLB)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+static int fds[PERFCTR_NUM] = {-1, -1, -1, -1, -1, -1};
+
+/*
+ * perfctr_init - Open the counters for this process
+ */
+int perfctr_init(void) {
+    struct perf_event_attr attr;
+    int i, opened = 0;
+
+    for (i = 0; i < PERFCTR_NUM; i++) {
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = events[i].type;
+        attr.config = events[i].config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;  /* allowed at perf_event_paranoid <= 2 */
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                           PERF_FORMAT_TOTAL_TIME_RUNNING;
+        fds[i] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        if (fds[i] >= 0)
+            opened++;
+    }
+    return opened;
+}
+
+/*
+ * perfctr_deinit - Close every open counter
+ */
+void perfctr_deinit(void) {
+    int i;
+
+    for (i = 0; i < PERFCTR_NUM; i++) {
+        if (fds[i] >= 0)
+            close(fds[i]);
+        fds[i] = -1;
+    }
+}
+
+/*
+ * perfctr_start - Reset and enable the open counters
+ */
+void perfctr_start(void) {
+    int i;
+
+    for (i = 0; i < PERFCTR_NUM; i++) {
+        if (fds[i] >= 0) {
+            ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+/*
+ * perfctr_stop - Disable the counters and read back their values,
+ *     scaling for any time the kernel multiplexed a counter out.
+ */
+void perfctr_stop(double *counts) {
+    unsigned long long buf[3]; /* value, time enabled, time running */
+    int i;
+
+    for (i = 0; i < PERFCTR_NUM; i++)
+        if (fds[i] >= 0)
+            ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+
+    for (i = 0; i < PERFCTR_NUM; i++) {
+        counts[i] = -1;
+        if (fds[i] < 0 || read(fds[i], buf, sizeof(buf)) != sizeof(buf))
+            continue;
+        if (buf[2] == 0)
+            continue;  /* never scheduled on the PMU */
+        counts[i] = (double)buf[0] * ((double)buf[1] / (double)buf[2]);
+    }
+}
+
+#else
+
+/*
+ * Platforms without perf_event_open: no counters are ever available.
+ */
+int perfctr_init(void) {
+    return 0;
+}
+
+void perfctr_deinit(void) {
+}
+
+void perfctr_start(void) {
+}
+
+void perfctr_stop(double *counts) {
+    int i;
+
+    for (i = 0; i < PERFCTR_NUM; i++)
+        counts[i] = -1;
+}
+
+#endif
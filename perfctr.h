@@ -0,0 +1,35 @@
+/*
+ * perfctr.h - prototypes for the routines in perfctr.c that read the
+ *     hardware performance counters around a test function
+ */
+
+/* The counters we try to open, in the order they are reported */
+#define PERFCTR_CYCLES        0
+#define PERFCTR_INSTRUCTIONS  1
+#define PERFCTR_L1D_MISSES    2
+#define PERFCTR_LLC_MISSES    3
+#define PERFCTR_DTLB_MISSES   4
+#define PERFCTR_BRANCH_MISSES 5
+#define PERFCTR_NUM           6
+
+/* Short column names for each counter */
+extern char *perfctr_names[PERFCTR_NUM];
+
+/* 
+ * perfctr_init - Open the counters for this process. Counters the
+ *     host does not support (or does not let us read) are skipped.
+ *     Returns the number of counters that were opened.
+ */
+int perfctr_init(void);
+
+/* perfctr_deinit - Close every open counter */
+void perfctr_deinit(void);
+
+/* perfctr_start - Reset and enable the open counters */
+void perfctr_start(void);
+
+/* 
+ * perfctr_stop - Disable the counters and store the event counts in
+ *     counts[PERFCTR_NUM]. Unavailable counters are reported as -1.
+ */
+void perfctr_stop(double *counts);
@@ -0,0 +1,176 @@
+/*
+ * trace.c - Routines for reading .rep trace files.
+ *
+ * A trace file starts with a four-line header (suggested heap size,
+ * number of ids, number of requests, weight), followed by one request
+ * per line:
+ *
+ *     a <id> <size>    allocate a block for id
+ *     r <id> <size>    reallocate id's block
+ *     f <id>           free id's block
+ *
+ * read_trace loads a whole trace for mdriver, which replays it many
+ * times. Tools that only need one pass over a trace, however large,
+ * read it a request at a time with trace_open and trace_next.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#include "trace.h"
+
+extern int verbose; /* -v option in mdriver.c */
+
+static void unix_error(char *msg);
+static void trace_error(char *msg, char *path);
+
+/*
+ * trace_open - Open a trace file and read its header into r
+ */
+int trace_open(trace_reader_t *r, char *path) {
+    if ((r->fp = fopen(path, "r")) == NULL)
+        return -1;
+    strncpy(r->path, path, sizeof(r->path) - 1);
+    r->path[sizeof(r->path) - 1] = '\0';
+    if (fscanf(r->fp, "%zu", &r->sugg_heapsize) != 1 ||
+        fscanf(r->fp, "%d", &r->num_ids) != 1 ||
+        fscanf(r->fp, "%d", &r->num_ops) != 1 ||
+        fscanf(r->fp, "%d", &r->weight) != 1)
+        trace_error("Bad header in tracefile", r->path);
+    r->opnum = 0;
+    return 0;
+}
+
+/*
+ * trace_next - Read the next request into op
+ */
+int trace_next(trace_reader_t *r, traceop_t *op) {
+    char type[2];
+    unsigned index;
+    size_t size = 0;
+    int n;
+
+    if (fscanf(r->fp, "%1s", type) != 1)
+        return 0;
+    switch (type[0]) {
+    case 'a':
+        n = fscanf(r->fp, "%u %zu", &index, &size);
+        op->type = ALLOC;
+        break;
+    case 'r':
+        n = fscanf(r->fp, "%u %zu", &index, &size);
+        op->type = REALLOC;
+        break;
+    case 'f':
+        n = fscanf(r->fp, "%u", &index) + 1;
+        op->type = FREE;
+        break;
+    default:
+        printf("Bogus type character (%c) in tracefile %s\n",
+               type[0], r->path);
+        exit(1);
+    }
+    if (n != 2)
+        trace_error("Truncated request in tracefile", r->path);
+    op->index = index;
+    op->size = size;
+    r->opnum++;
+    return 1;
+}
+
+/*
+ * trace_close - Close a trace opened by trace_open
+ */
+void trace_close(trace_reader_t *r) {
+    fclose(r->fp);
+}
+
+/*
+ * read_trace - read a trace file and store it in memory
+ */
+trace_t *read_trace(char *tracedir, char *filename) {
+    trace_reader_t r;
+    trace_t *trace;
+    char path[2048];
+    char msg[2048];
+    int max_index = -1;
+    int op_index = 0;
+
+    if (verbose > 1)
+        printf("Reading tracefile: %s\n", filename);
+
+    /* Allocate the trace record */
+    if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
+        unix_error("malloc 1 failed in read_trace");
+
+    /* Read the trace file header */
+    sprintf(path, "%.1000s%.1000s", tracedir, filename);
+    strncpy(trace->trace_name, filename, 1023);
+    trace->trace_name[1023] = '\0';
+    if (trace_open(&r, path) < 0) {
+        sprintf(msg, "Could not open %.1000s in read_trace", path);
+        unix_error(msg);
+    }
+    trace->sugg_heapsize = r.sugg_heapsize;
+    trace->num_ids = r.num_ids;
+    trace->num_ops = r.num_ops;
+    trace->weight = r.weight;
+
+    /* We'll store each request line in the trace in this array */
+    if ((trace->ops =
+                (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
+        unix_error("malloc 2 failed in read_trace");
+
+    /* We'll keep an array of pointers to the allocated blocks here... */
+    if ((trace->blocks =
+                (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
+        unix_error("malloc 3 failed in read_trace");
+
+    /* ... along with the corresponding byte sizes of each block */
+    if ((trace->block_sizes =
+                (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
+        unix_error("malloc 4 failed in read_trace");
+
+    /* read every request line in the trace file */
+    while (op_index < trace->num_ops &&
+           trace_next(&r, &trace->ops[op_index])) {
+        if (trace->ops[op_index].type != FREE &&
+            trace->ops[op_index].index > max_index)
+            max_index = trace->ops[op_index].index;
+        op_index++;
+    }
+    trace_close(&r);
+    assert(max_index == trace->num_ids - 1);
+    assert(op_index == trace->num_ops);
+
+    return trace;
+}
+
+/*
+ * free_trace - Free the trace record and the three arrays it points
+ *              to, all of which were allocated in read_trace().
+ */
+void free_trace(trace_t *trace) {
+    free(trace->ops);         /* free the three arrays... */
+    free(trace->blocks);
+    free(trace->block_sizes);
+    free(trace);              /* and the trace record itself... */
+}
+
+/*
+ * unix_error - Report a failed library call and exit
+ */
+static void unix_error(char *msg) {
+    printf("%s: %s\n", msg, strerror(errno));
+    exit(1);
+}
+
+/*
+ * trace_error - Report a malformed trace file and exit
+ */
+static void trace_error(char *msg, char *path) {
+    printf("%s %s\n", msg, path);
+    exit(1);
+}
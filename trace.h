@@ -0,0 +1,59 @@
+/*
+ * trace.h - The in-memory form of a .rep trace file, and the routines
+ *     in trace.c that read one, either whole or one request at a time
+ */
+#include <stdio.h>
+
+/* Characterizes a single trace operation (allocator request) */
+typedef struct {
+    enum {ALLOC, FREE, REALLOC} type; /* type of request */
+    int index;                        /* index for free() to use later */
+    size_t size;                      /* byte size of alloc/realloc request */
+} traceop_t;
+
+/* Holds the information for one trace file*/
+typedef struct {
+    char trace_name[1024];
+    size_t sugg_heapsize; /* suggested heap size (mdriver -H) */
+    int num_ids;         /* number of alloc/realloc ids */
+    int num_ops;         /* number of distinct requests */
+    int weight;          /* weight in the perf index (mdriver -w overrides) */
+    traceop_t *ops;      /* array of requests */
+    char **blocks;       /* array of ptrs returned by malloc/realloc... */
+    size_t *block_sizes; /* ... and a corresponding array of payload sizes */
+} trace_t;
+
+/* An open trace file being read one request at a time */
+typedef struct {
+    FILE *fp;
+    char path[1024];
+    size_t sugg_heapsize; /* the header, as in trace_t */
+    int num_ids;
+    int num_ops;
+    int weight;
+    int opnum;           /* requests read so far */
+} trace_reader_t;
+
+/*
+ * read_trace - Read the trace file tracedir/filename into memory.
+ *     Exits with a message if the file cannot be read.
+ */
+trace_t *read_trace(char *tracedir, char *filename);
+
+/* free_trace - Free a trace returned by read_trace */
+void free_trace(trace_t *trace);
+
+/*
+ * trace_open - Open a trace file and read its header into r.
+ *     Returns 0 on success and -1 if the file cannot be opened.
+ */
+int trace_open(trace_reader_t *r, char *path);
+
+/*
+ * trace_next - Read the next request into op. Returns 1 if a request
+ *     was read, 0 at the end of the file. Exits on a malformed request.
+ */
+int trace_next(trace_reader_t *r, traceop_t *op);
+
+/* trace_close - Close a trace opened by trace_open */
+void trace_close(trace_reader_t *r);